@@ -0,0 +1,55 @@
+/*
+@file: file_util.c
+@brief: 卡上文件记录共用的小工具
+        录音容器、录音目录、媒体库索引、跳转表和断点续播都用同一个CRC32校验记录，
+        不跟着任何一个模块的开关走
+@date: 2026/10/19
+*/
+
+#include <string.h>
+#include "app_config.h"
+#include "file_util.h"
+
+static u32 crc32_table[256];
+static u8 crc32_init_done;
+
+static void file_crc32_init(void)
+{
+    for (u32 i = 0; i < 256; i++) {
+        u32 c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+        }
+        crc32_table[i] = c;
+    }
+    crc32_init_done = 1;
+}
+
+u32 file_crc32(u32 crc, const void *data, u32 len)
+{
+    const u8 *p = (const u8 *)data;
+
+    if (!crc32_init_done) {
+        file_crc32_init();
+    }
+    crc = ~crc;
+    while (len--) {
+        crc = crc32_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+int file_path_len(const char *path)
+{
+    const char *u = strstr(path, "\\U");
+    int len;
+
+    if (!u) {
+        return strlen(path);
+    }
+    len = u - path + 2;
+    while (path[len] || path[len + 1]) {
+        len += 2;
+    }
+    return len;
+}
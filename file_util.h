@@ -0,0 +1,16 @@
+/*
+@file: file_util.h
+@brief: 卡上文件记录共用的小工具：CRC32、长文件名路径长度
+@date: 2026/10/19
+*/
+#ifndef _FILE_UTIL_H_
+#define _FILE_UTIL_H_
+
+#include "app_config.h"
+
+//标准CRC32(多项式0xedb88320)，crc传上一段的结果可以分段算，第一段传0
+u32 file_crc32(u32 crc, const void *data, u32 len);
+//get_file_name()生成的"\U"长文件名中间带0，不能直接用strlen
+int file_path_len(const char *path);
+
+#endif
@@ -25,12 +25,20 @@
 // 结构体声明
 struct feedback_suppressor;
 struct recorder_hdl;
+struct rec_rollover;
+struct rec_adpcm;
 
 // 函数声明
-void analyze_spectrum(const int16_t *samples, int num_samples);
 float feedback_cancellation(int16_t sample);
 void init_adaptive_params();
 int adapt_filter();
+int spectrum_frontend_push(const float *samples, int num_samples);
+int feedback_gate_update(const int16_t *samples, int num_samples);
+void feedback_gate_set_vad(u8 speech);
+void feedback_gate_set_floor(int floor_db);
+void feedback_process_block(const float *in, float *out, int num_samples);
+void feedback_suppressor_rescale(int sample_rate);
+int feedback_analyze(const int16_t *samples, int num_samples);
 
 #define MAX_SUPPRESSORS 3           // 最多同时抑制3个频点
 #define NOTCH_FILTER_ORDER 4             // 陷波滤波器阶数
@@ -40,12 +48,28 @@ int adapt_filter();
 #define DEFAULT_Q 2.2f         // 默认Q值
 #define THRESHOLD_DB -35.0f     // 啸叫检测阈值(dB)
 #define ADAPT_INTERVAL 16000    // 每16000样本调整一次(约1秒@16kHz)
+#define SPECTRUM_HOP (FFT_SIZE * 2)     // 共享频谱每隔多少样本做一次FFT，不小于FFT_SIZE
+#define SPECTRUM_BANDS 16               // 显示用的对数频带数
+#define FEEDBACK_GATE_FLOOR_DB -60      // 静音旁路门限(dBFS)，低于此值停止分析和陷波
+#define FEEDBACK_GATE_HYST_DB 6         // 回差，高于门限+回差立即恢复
+#define FEEDBACK_GATE_HOLD_BLOCKS 25    // 连续多少块静音才进入旁路
+#define FEEDBACK_GATE_BYPASS_GAIN 1.0f  // 旁路时的增益
+#define FEEDBACK_DSP_RATE 16000         // 高采样率时降到此采样率做检测和陷波
 //#define M_PI 3.141592653589793238462643383279502884197169399375105820974944
 #define CLAMP(x, min, max) ((x) < (min) ? (min) : ((x) > (max) ? (max) : (x)))
 
 #endif
 
 #ifdef FEEDBACK_SUPPRESSION_ENABLE
+//共享频谱快照，啸叫检测和频谱显示共用一次FFT；seq为奇数表示正在更新
+struct spectrum_snapshot {
+    volatile u32 seq;
+    s16 band_db[SPECTRUM_BANDS];    // 各频带平均能量(dB)
+    float mag[FFT_SIZE/2];          // 完整幅度谱
+};
+
+int spectrum_snapshot_read(struct spectrum_snapshot *snap);
+
 struct feedback_suppressor {
     float coeff[NOTCH_FILTER_ORDER+1];    // 滤波器系数
     float x_buf[NOTCH_FILTER_ORDER+1];    // 输入缓冲区
@@ -69,6 +93,8 @@ struct feedback_suppressor {
 struct recorder_hdl {
     FILE *fp;
     FILE *rec_fp;//录音专用文件句柄
+    struct rec_rollover *rec_ro; //分块录音容器(按大小/时长自动切分)
+    struct rec_adpcm *rec_adpcm; //ADPCM录音(不经过编码服务器)
     struct server *enc_server;
     struct server *enc_server_rec; //录音专用服务
     struct server *dec_server;    
@@ -90,15 +116,15 @@ struct recorder_hdl {
     int suppress_freq;        // 当前抑制频率
     float q_factor;          // Q值
     float threshold;         // 啸叫检测阈值
-    int adapt_interval;      // 自适应调整间隔(样本数)
-    int sample_counter;      // 样本计数器
     float spectrum[FFT_SIZE/2]; // 频谱分析缓冲区
+    u8 analog_direct;        // 模拟直通在跑，开抑制时据此补开旁路检测
+    u8 hybrid;               // 模拟直通，数字旁路只做啸叫检测
+    volatile u8 hybrid_howl; // 旁路检测到啸叫，控制定时器取走后清零
+    u8 hybrid_duck;          // 当前模拟增益压低量
+    u16 hybrid_quiet_ms;     // 啸叫消失后经过的时间
+    u16 hybrid_timer_id;
 #endif
 #ifdef CONFIG_SPECTRUM_FFT_EFFECT_ENABLE
-    void *work_buf;
-    s16 *out_buf;
-    u32 out_buf_size;
-    u32 offset;
     u16 show_timer_id;
 #endif
 };
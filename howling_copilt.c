@@ -9,6 +9,8 @@
 #include <string.h>
 #include "jl_math/kiss_fft.h"
 #include "howling.h"
+#include "resample.h"
+#include "pcm_convert.h"
 
 // #define MAX_SUPPRESSORS 3           // 最多同时抑制3个频点
 // #define NOTCH_FILTER_ORDER 2        // 陷波器阶数
@@ -52,6 +54,47 @@ static kiss_fft_cfg fft_cfg = NULL;
 static float hann_window[FFT_SIZE];
 static int fft_init_done = 0;
 
+// ----------- 共享频谱前端 ----------
+#define ANA_CHUNK 160   // 分析输入每次转换的样本数，抽取后不超过RS_CHUNK
+static float ana_buf[ANA_CHUNK];
+static float stft_buf[FFT_SIZE];
+static int stft_fill = 0;
+static int stft_skip = 0;
+static u8 band_edge[SPECTRUM_BANDS+1];
+static struct spectrum_snapshot spec_snap;
+
+// ----------- 静音旁路 ----------
+static struct {
+    u32 off_energy;     // 低于此均方值算静音
+    u32 on_energy;      // 高于此均方值立即恢复
+    u16 quiet_blocks;
+    u8 active;          // 1:完整处理 0:旁路，陷波器状态冻结
+    u8 vad;             // 外部VAD判为语音时不旁路
+    u8 engaged;         // 最近一次检测到啸叫，陷波器生效
+    u8 last_path;       // 上一块实际走的路径，1:陷波 0:直通
+} gate = {0, 0, 0, 1, 0, 0, 0};
+
+// ----------- 降采样处理 ----------
+// 检测和陷波都在dsp_rate下进行；I/O采样率是dsp_rate整数倍时，
+// 输出 = 延迟对齐的原始信号 + 插值(陷波输出 - 陷波输入)，只把修正量升回高采样率；
+// 块长不是倍数的整数倍时，抽取器的相位和插值多出的修正量留到下一块，
+// 整体多延迟factor-1个样本，保证每个输出样本的修正量都已经算好
+static int dsp_rate = 16000;
+static int io_factor = 1;
+#ifdef RESAMPLE_ENABLE
+#define RS_CHUNK 80     // 每次处理的低采样率样本数
+static struct resample dec_ana;     // 分析用抽取器
+static struct resample dec_proc;    // 陷波用抽取器
+static struct resample interp;
+static float rs_delay[RESAMPLE_MAX_TAPS];
+static int rs_delay_len;
+static int rs_delay_pos;
+static float rs_low[RS_CHUNK];
+static float rs_corr[RS_CHUNK];
+static float rs_high[(RS_CHUNK + 1) * RESAMPLE_MAX_FACTOR];
+static int rs_high_len;     // rs_high开头留到下一块用的修正量个数
+#endif
+
 // 初始化FFT和窗函数
 static void fft_global_init() {
     if (!fft_init_done) {
@@ -59,6 +102,13 @@ static void fft_global_init() {
         for (int i = 0; i < FFT_SIZE; i++) {
             hann_window[i] = 0.5f * (1 - cosf(2*M_PI*i/(FFT_SIZE-1)));
         }
+        // 频带按对数划分，低频每带至少一个bin
+        band_edge[0] = 1;
+        for (int b = 1; b <= SPECTRUM_BANDS; b++) {
+            int e = (int)(powf(FFT_SIZE/2, (float)b/SPECTRUM_BANDS) + 0.5f);
+            if (e <= band_edge[b-1]) e = band_edge[b-1] + 1;
+            band_edge[b] = e > FFT_SIZE/2 ? FFT_SIZE/2 : e;
+        }
         fft_init_done = 1;
     }
 }
@@ -130,8 +180,10 @@ static void update_notch_target(struct feedback_suppressor *sup, float freq, flo
 }
 
 static void notch_filter_smooth(struct feedback_suppressor *sup, float sample_rate) {
-    // freq/q平滑过渡
+    // freq/q平滑过渡，已经到位时系数不变，不用每个样本重算三角函数
     float step_f = 10.0f, step_q = 0.1f;
+    if (sup->freq_current == sup->freq_target && sup->q_current == sup->q_target)
+        return;
     if (fabs(sup->freq_current - sup->freq_target) > step_f)
         sup->freq_current += (sup->freq_target > sup->freq_current ? step_f : -step_f);
     else
@@ -145,9 +197,8 @@ static void notch_filter_smooth(struct feedback_suppressor *sup, float sample_ra
     notch_filter_param(sup, sup->freq_current, sample_rate, sup->q_current);
 }
 
-// 对单通道样本做多陷波处理
-float feedback_cancellation(s16 sample) {
-    float out = sample;
+// 多陷波级联，级间不限幅
+static inline float notch_cascade(float out) {
     for (int k = 0; k < MAX_SUPPRESSORS; k++) {
         struct feedback_suppressor *sup = &fb_suppressors[k];
         sup->x_buf[sup->buf_pos] = out;
@@ -159,18 +210,23 @@ float feedback_cancellation(s16 sample) {
         sup->y_buf[sup->buf_pos] = y;
         sup->buf_pos = (sup->buf_pos + 1) % (NOTCH_FILTER_ORDER+1);
         // 平滑参数
-        notch_filter_smooth(sup, __this->sample_rate);
+        notch_filter_smooth(sup, dsp_rate);
         out = y;
     }
+    return out;
+}
+
+// 对单通道样本做多陷波处理，16位接口
+float feedback_cancellation(s16 sample) {
+    float out = notch_cascade(sample);
     return CLAMP(out, -32768.0f, 32767.0f);
 }
 
 // ---------- 初始化与分析 ----------
+// 只初始化算法状态，按FEEDBACK_DSP_RATE建陷波器；句柄的采样率由调用者定，
+// 再用feedback_suppressor_rescale换算到实际I/O采样率
 void init_adaptive_params() {
-    __this->sample_rate = 16000; // 可由外部配置
     __this->threshold = powf(10.0f, THRESHOLD_DB/20.0f);
-    __this->adapt_interval = FFT_SIZE * 2;
-    __this->sample_counter = 0;
     memset(__this->spectrum, 0, sizeof(__this->spectrum));
 
     for (int i = 0; i < MAX_SUPPRESSORS; i++) {
@@ -179,25 +235,81 @@ void init_adaptive_params() {
         fb_suppressors[i].freq_target = 0;
         fb_suppressors[i].q_current = DEFAULT_Q;
         fb_suppressors[i].q_target = DEFAULT_Q;
-        notch_filter_param(&fb_suppressors[i], 0, __this->sample_rate, DEFAULT_Q);
+        notch_filter_param(&fb_suppressors[i], 0, FEEDBACK_DSP_RATE, DEFAULT_Q);
     }
+    dsp_rate = FEEDBACK_DSP_RATE;
+    io_factor = 1;
 }
 
-// FFT分析入口
-void analyze_spectrum(const s16 *samples, int num_samples) {
-    if (num_samples < FFT_SIZE) return;
+// 发布一帧频谱给显示等其他模块
+static void spectrum_publish(const float *mag) {
+    spec_snap.seq++;
+    memcpy(spec_snap.mag, mag, sizeof(spec_snap.mag));
+    for (int b = 0; b < SPECTRUM_BANDS; b++) {
+        float sum = 0;
+        int n = band_edge[b+1] - band_edge[b];
+        for (int i = band_edge[b]; i < band_edge[b+1]; i++)
+            sum += mag[i] * mag[i];
+        spec_snap.band_db[b] = n > 0 ? (s16)(10 * log10f(sum / n + 1e-9f)) : 0;
+    }
+    spec_snap.seq++;
+}
+
+// 共享频谱前端：每SPECTRUM_HOP个样本做一次加窗FFT，结果写入__this->spectrum并发布快照
+// 返回本次产生的新频谱帧数
+int spectrum_frontend_push(const float *samples, int num_samples) {
+    int frames = 0;
     fft_global_init();
-    float windowed[FFT_SIZE];
-    for (int i = 0; i < FFT_SIZE; i++)
-        windowed[i] = samples[i] * hann_window[i];
-    fft_execute(windowed, __this->spectrum, FFT_SIZE);
+    while (num_samples > 0) {
+        int k;
+        if (stft_skip) {
+            k = stft_skip < num_samples ? stft_skip : num_samples;
+            stft_skip -= k;
+            samples += k;
+            num_samples -= k;
+            continue;
+        }
+        k = FFT_SIZE - stft_fill;
+        if (k > num_samples) k = num_samples;
+        memcpy(stft_buf + stft_fill, samples, k * sizeof(float));
+        stft_fill += k;
+        samples += k;
+        num_samples -= k;
+        if (stft_fill == FFT_SIZE) {
+            float windowed[FFT_SIZE];
+            for (int i = 0; i < FFT_SIZE; i++)
+                windowed[i] = stft_buf[i] * hann_window[i];
+            fft_execute(windowed, __this->spectrum, FFT_SIZE);
+            spectrum_publish(__this->spectrum);
+            stft_fill = 0;
+            stft_skip = SPECTRUM_HOP - FFT_SIZE;
+            frames++;
+        }
+    }
+    return frames;
+}
+
+// 读取最新频谱快照，写入方在中断里，读到一半被打断就重读
+int spectrum_snapshot_read(struct spectrum_snapshot *snap) {
+    for (int retry = 0; retry < 4; retry++) {
+        u32 seq = spec_snap.seq;
+        if (seq & 1) continue;
+        memcpy(snap->band_db, spec_snap.band_db, sizeof(snap->band_db));
+        memcpy(snap->mag, spec_snap.mag, sizeof(snap->mag));
+        if (seq == spec_snap.seq) {
+            snap->seq = seq;
+            return 0;
+        }
+    }
+    return -1;
 }
 
 // ---------- 多频点自适应调整 ----------
 int adapt_filter() {
     int freqs[MAX_SUPPRESSORS] = {0};
     float peaks[MAX_SUPPRESSORS] = {0};
-    int found = multi_peak_detect(__this->spectrum, __this->sample_rate, freqs, peaks);
+    int found = multi_peak_detect(__this->spectrum, dsp_rate, freqs, peaks);
+    gate.engaged = found > 0;
 
     for (int i = 0; i < MAX_SUPPRESSORS; i++) {
         if (i < found && freqs[i] > 0) {
@@ -211,3 +323,187 @@ int adapt_filter() {
     }
     return found;
 }
+
+// ---------- 静音旁路 ----------
+void feedback_gate_set_floor(int floor_db) {
+    float amp = 32768.0f * powf(10.0f, floor_db/20.0f);
+    gate.off_energy = (u32)(amp * amp);
+    amp *= powf(10.0f, FEEDBACK_GATE_HYST_DB/20.0f);
+    gate.on_energy = (u32)(amp * amp);
+}
+
+// 编码器VAD事件，语音期间不进入旁路
+void feedback_gate_set_vad(u8 speech) {
+    gate.vad = speech;
+}
+
+// 按块能量更新门限状态，返回1表示本块需要做分析
+int feedback_gate_update(const s16 *samples, int num_samples) {
+    u64 acc = 0;
+    u32 energy;
+
+    if (num_samples <= 0) return gate.active;
+    if (!gate.on_energy) feedback_gate_set_floor(FEEDBACK_GATE_FLOOR_DB);
+    for (int i = 0; i < num_samples; i++)
+        acc += (s32)samples[i] * samples[i];
+    energy = (u32)(acc / num_samples);
+
+    if (gate.vad || energy > gate.on_energy) {
+        gate.active = 1;
+        gate.quiet_blocks = 0;
+    } else if (energy < gate.off_energy) {
+        if (gate.active && ++gate.quiet_blocks >= FEEDBACK_GATE_HOLD_BLOCKS)
+            gate.active = 0;
+    } else {
+        gate.quiet_blocks = 0;
+    }
+    return gate.active;
+}
+
+// 分析入口：高采样率时先抽取再送共享频谱前端，返回新频谱帧数
+int feedback_analyze(const s16 *samples, int num_samples) {
+    int frames = 0;
+
+    while (num_samples > 0) {
+        int n = num_samples < ANA_CHUNK ? num_samples : ANA_CHUNK;
+        pcm_s16_to_float(samples, 1, ana_buf, n);
+#ifdef RESAMPLE_ENABLE
+        if (io_factor > 1) {
+            int m = resample_decimate(&dec_ana, ana_buf, n, rs_low);
+            frames += spectrum_frontend_push(rs_low, m);
+        } else
+#endif
+        frames += spectrum_frontend_push(ana_buf, n);
+        samples += n;
+        num_samples -= n;
+    }
+    return frames;
+}
+
+#ifdef RESAMPLE_ENABLE
+// 低采样率块处理，延迟线始终运行，直通和陷波两条路径延迟一致
+static void feedback_process_lowrate(const float *in, float *out, int num_samples, u8 path) {
+    u8 fade = path != gate.last_path;
+    int total = num_samples / io_factor;
+    int done = 0;
+
+    if (total < 1) total = 1;
+    while (num_samples > 0) {
+        int n = num_samples < RS_CHUNK * io_factor ? num_samples : RS_CHUNK * io_factor;
+        int m = 0;
+        u8 corr = path || fade;
+
+        if (corr) {
+            m = resample_decimate(&dec_proc, in, n, rs_low);
+            for (int j = 0; j < m; j++) {
+                float d = rs_low[j];
+                float w = 1.0f;
+                if (fade) {
+                    w = (float)(done + j + 1) / total;
+                    if (w > 1.0f) w = 1.0f;
+                    if (!path) w = 1.0f - w;
+                }
+                rs_corr[j] = w * (notch_cascade(d) - d);
+            }
+            rs_high_len += resample_interpolate(&interp, rs_corr, m, rs_high + rs_high_len);
+        }
+        for (int i = 0; i < n; i++) {
+            float x = rs_delay[rs_delay_pos] * FEEDBACK_GATE_BYPASS_GAIN;
+            rs_delay[rs_delay_pos] = in[i];
+            if (++rs_delay_pos == rs_delay_len) rs_delay_pos = 0;
+            out[i] = corr ? x + rs_high[i] : x;
+        }
+        //旁路时抽取器不走，留下的修正量个数和抽取器相位一起保持不变
+        if (corr) {
+            rs_high_len -= n;
+            memmove(rs_high, rs_high + n, rs_high_len * sizeof(float));
+        }
+        done += m;
+        in += n;
+        out += n;
+        num_samples -= n;
+    }
+    gate.last_path = path;
+}
+#endif
+
+// 块处理入口：静音或没有啸叫时只做增益直通，陷波器和平滑状态保持不动；
+// 路径切换的那一块在直通和陷波输出之间线性交叉淡化，避免爆音；
+// 浮点进出，in和out可以是同一块缓冲，不限幅，由DAC出口统一饱和
+void feedback_process_block(const float *in, float *out, int num_samples) {
+    u8 path = gate.active && gate.engaged;
+
+#ifdef RESAMPLE_ENABLE
+    // 陷波系数按dsp_rate设计，降采样时不能在高采样率上直接跑
+    if (io_factor > 1) {
+        feedback_process_lowrate(in, out, num_samples, path);
+        return;
+    }
+#endif
+
+    if (!path && !gate.last_path) {
+        for (int i = 0; i < num_samples; i++)
+            out[i] = in[i] * FEEDBACK_GATE_BYPASS_GAIN;
+        return;
+    }
+
+    if (path == gate.last_path) {
+        for (int i = 0; i < num_samples; i++)
+            out[i] = notch_cascade(in[i]);
+        return;
+    }
+
+    for (int i = 0; i < num_samples; i++) {
+        float x = in[i] * FEEDBACK_GATE_BYPASS_GAIN;
+        float y = notch_cascade(in[i]);
+        float w = (float)(i + 1) / num_samples;
+        if (!path) w = 1.0f - w;
+        out[i] = x + w * (y - x);
+    }
+    gate.last_path = path;
+}
+
+// ---------- 运行中切换采样率 ----------
+// sample_rate为I/O采样率，能整数倍降到FEEDBACK_DSP_RATE时内部仍按低采样率处理，
+// 陷波系数不用变；否则陷波频点按Hz保存，按新采样率重算系数，超出奈奎斯特范围的关闭
+void feedback_suppressor_rescale(int sample_rate) {
+    int factor = 1;
+    int rate;
+    float limit;
+
+    if (sample_rate <= 0) return;
+#ifdef RESAMPLE_ENABLE
+    if (sample_rate > FEEDBACK_DSP_RATE && sample_rate % FEEDBACK_DSP_RATE == 0 &&
+        sample_rate / FEEDBACK_DSP_RATE <= RESAMPLE_MAX_FACTOR) {
+        factor = sample_rate / FEEDBACK_DSP_RATE;
+    }
+    if (factor != io_factor && factor > 1) {
+        resample_init_decimator(&dec_ana, factor);
+        resample_init_decimator(&dec_proc, factor);
+        resample_init_interpolator(&interp, factor);
+        // 多延迟factor-1，对齐预先留好的factor-1个修正量
+        rs_delay_len = resample_delay(&dec_proc) + factor - 1;
+        rs_delay_pos = 0;
+        memset(rs_delay, 0, sizeof(rs_delay));
+        rs_high_len = factor - 1;
+        memset(rs_high, 0, sizeof(rs_high));
+    }
+#endif
+    io_factor = factor;
+    rate = sample_rate / factor;
+    if (rate == dsp_rate) return;
+
+    limit = rate * 0.45f;
+    for (int i = 0; i < MAX_SUPPRESSORS; i++) {
+        struct feedback_suppressor *sup = &fb_suppressors[i];
+        if (sup->freq_current > limit || sup->freq_target > limit) {
+            sup->freq_current = sup->freq_target = 0;
+        }
+        notch_filter_param(sup, sup->freq_current, rate, sup->q_current);
+    }
+    dsp_rate = rate;
+    // 旧采样率的分析数据作废，下一帧频谱按新采样率重新积累
+    stft_fill = 0;
+    stft_skip = 0;
+    memset(__this->spectrum, 0, sizeof(__this->spectrum));
+}
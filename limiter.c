@@ -0,0 +1,132 @@
+/*
+@file: limiter.c
+@brief: 监听通路输出限幅器+压缩器
+        输入先进一段两控制块长的延迟线，每收满一块按延迟线里两块的峰值算限幅增益，
+        输出时增益在块内线性过渡；过渡两端的增益都已经覆盖正在输出的那一块，
+        峰值到达输出端之前增益已经降到位，不会削顶；
+        压缩器按块峰值包络算增益，和限幅增益取小，只往下压不做提升；
+        浮点进出，幅度按16位满量程计，出口转16位时不会再削顶
+@date: 2026/10/19
+*/
+
+#include <math.h>
+#include <string.h>
+#include "app_config.h"
+#include "limiter.h"
+
+#ifdef LIMITER_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[LIMITER]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+#define DB_TO_LINEAR(db)    powf(10.0f, (db) / 20.0f)
+
+//时间常数换算成每个控制块的一阶平滑系数
+static float limiter_coef(int block, int sample_rate, int ms)
+{
+    return 1.0f - expf(-(float)block * 1000 / ((float)sample_rate * ms));
+}
+
+void limiter_init(struct limiter *lim, int sample_rate)
+{
+    int block = sample_rate * LIMITER_LOOKAHEAD_MS / 2000;
+
+    memset(lim, 0, sizeof(*lim));
+    if (block < 1) {
+        block = 1;
+    }
+    if (block * 2 > LIMITER_MAX_DELAY) {
+        block = LIMITER_MAX_DELAY / 2;
+    }
+    lim->block = block;
+    lim->gain = lim->gain_target = 1.0f;
+    lim->rel = limiter_coef(block, sample_rate, LIMITER_RELEASE_MS);
+    limiter_set_ceiling(lim, LIMITER_CEILING_DB);
+    limiter_set_compressor(lim, sample_rate, LIMITER_COMP_THRESHOLD_DB, LIMITER_COMP_RATIO);
+
+    log_info("init: %dHz block %d delay %d", sample_rate, block, block * 2);
+}
+
+void limiter_set_ceiling(struct limiter *lim, float db)
+{
+    lim->ceiling = 32767.0f * DB_TO_LINEAR(db);
+}
+
+void limiter_set_compressor(struct limiter *lim, int sample_rate, float threshold_db, float ratio)
+{
+    if (ratio <= 1.0f) {
+        lim->comp_thr = 0;
+        return;
+    }
+    lim->comp_thr = 32767.0f * DB_TO_LINEAR(threshold_db);
+    lim->comp_slope = 1.0f / ratio - 1.0f;
+    lim->comp_att = limiter_coef(lim->block, sample_rate, LIMITER_COMP_ATTACK_MS);
+    lim->comp_rel = limiter_coef(lim->block, sample_rate, LIMITER_COMP_RELEASE_MS);
+}
+
+//收满一个控制块，算下一块的目标增益
+static void limiter_update(struct limiter *lim)
+{
+    float peak = lim->peak_cur > lim->peak_last ? lim->peak_cur : lim->peak_last;
+    float target = peak > lim->ceiling ? lim->ceiling / peak : 1.0f;
+    float prev = lim->gain_target;
+    float next;
+
+    if (lim->comp_thr > 0) {
+        float k = lim->peak_cur > lim->env ? lim->comp_att : lim->comp_rel;
+        lim->env += (lim->peak_cur - lim->env) * k;
+        if (lim->env > lim->comp_thr) {
+            float g = powf(lim->env / lim->comp_thr, lim->comp_slope);
+            if (g < target) {
+                target = g;
+            }
+        }
+    }
+
+    //下降一块内到位，回升按释放时间常数
+    next = target < prev ? target : prev + (target - prev) * lim->rel;
+
+    lim->gain = prev;
+    lim->gain_target = next;
+    lim->gain_step = (next - prev) / lim->block;
+    lim->peak_last = lim->peak_cur;
+    lim->peak_cur = 0;
+}
+
+//块处理，in和out可以是同一块缓冲；输出比输入晚两个控制块
+void limiter_process(struct limiter *lim, const float *in, float *out, int n)
+{
+    int len = lim->block * 2;
+
+    for (int i = 0; i < n; i++) {
+        float x = in[i];
+        float y = lim->delay[lim->pos] * lim->gain;
+
+        lim->gain += lim->gain_step;
+        lim->delay[lim->pos] = x;
+        if (++lim->pos == len) {
+            lim->pos = 0;
+        }
+        x = fabsf(x);
+        if (x > lim->peak_cur) {
+            lim->peak_cur = x;
+        }
+        out[i] = y;
+
+        if (++lim->fill == lim->block) {
+            lim->fill = 0;
+            limiter_update(lim);
+        }
+    }
+}
+
+//当前增益，用于显示增益衰减量
+float limiter_gain(const struct limiter *lim)
+{
+    return lim->gain;
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*
+@file: limiter.h
+@brief: 监听通路输出限幅器+压缩器
+@date: 2026/10/19
+*/
+#ifndef _LIMITER_H_
+#define _LIMITER_H_
+
+#include "app_config.h"
+
+#define LIMITER_ENABLE          // 输出限幅开关
+
+#ifdef LIMITER_ENABLE
+
+#define LIMITER_LOOKAHEAD_MS    1       // 预读延迟，分成两个控制块
+#define LIMITER_MAX_DELAY       96      // 延迟线最大样本数(48K下2ms)
+#define LIMITER_CEILING_DB      -1.0f   // 输出峰值上限(dBFS)
+#define LIMITER_RELEASE_MS      80      // 限幅释放时间
+#define LIMITER_COMP_THRESHOLD_DB   -12.0f  // 压缩起始电平(dBFS)
+#define LIMITER_COMP_RATIO      2.0f    // 压缩比，<=1时不压缩
+#define LIMITER_COMP_ATTACK_MS  5
+#define LIMITER_COMP_RELEASE_MS 150
+
+struct limiter {
+    int block;                      // 控制块样本数，每块算一次增益
+    int pos;                        // 延迟线读写位置
+    int fill;                       // 当前控制块已收的样本数
+    float ceiling;                  // 线性峰值上限
+    float peak_cur;                 // 正在收的控制块峰值
+    float peak_last;                // 上一个控制块峰值
+    float gain;                     // 当前输出样本的增益
+    float gain_step;                // 本块内每个样本的增益增量
+    float gain_target;              // 本块结束时的增益
+    float rel;                      // 限幅释放系数(每块)
+    float comp_thr;                 // 压缩门限，0时不压缩
+    float comp_slope;               // 1/ratio - 1
+    float comp_att;
+    float comp_rel;
+    float env;                      // 压缩器包络
+    float delay[LIMITER_MAX_DELAY];
+};
+
+void limiter_init(struct limiter *lim, int sample_rate);
+void limiter_set_ceiling(struct limiter *lim, float db);
+void limiter_set_compressor(struct limiter *lim, int sample_rate, float threshold_db, float ratio);
+void limiter_process(struct limiter *lim, const float *in, float *out, int n);
+float limiter_gain(const struct limiter *lim);
+
+#endif
+
+#endif
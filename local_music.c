@@ -8,29 +8,114 @@
 #include "syscfg/syscfg_id.h"
 #include "system/wait.h"
 #include "system/app_core.h"
+#include "system/timer.h"
+#include "music_index.h"
+#include "music_cache.h"
+#include "music_resume.h"
+#include "music_seek.h"
+#include "music_shuffle.h"
+#include "music_mix.h"
 
 #ifdef CONFIG_RECORDER_MODE_ENABLE
 
 #define CONFIG_STORE_VOLUME
+#define LOCAL_MUSIC_VOL_SAVE_MS     2000    //调音量停下这么久才写syscfg，连按只写一次
 #define VOLUME_STEP 5
 #define MIN_VOLUME_VALUE	5
 #define MAX_VOLUME_VALUE	100
 #define INIT_VOLUME_VALUE   5
 
+#ifdef MUSIC_INDEX_ENABLE
+#define LOCAL_MUSIC_GAPLESS_ENABLE      //无缝切歌：播放中预开下一首，需要媒体库索引给出下一首
+#define LOCAL_MUSIC_PRELOAD_DELAY_MS 1000   //开始播放后多久预开下一首，避开起播时的读卡
+#endif
+#define LOCAL_MUSIC_DEC_BUF_LEN     (6 * 1024)  //解码器输出缓冲
+//切歌后上一首的输出缓冲放完要多久，按最低的8k单声道估，再留DAC缓冲的余量
+#define LOCAL_MUSIC_DRAIN_MS        (LOCAL_MUSIC_DEC_BUF_LEN * 1000 / (8000 * 2) + 100)
+
+#ifdef MUSIC_INDEX_ENABLE
+#define LOCAL_MUSIC_SCAN_POLL_MS    200     //后台建索引时查看进度的间隔
+#define LOCAL_MUSIC_BAD_ERR_SEC     3       //开播这么多秒内解码出错的记为坏文件，以后切歌直接跳过
+#endif
+
+#if defined(MUSIC_INDEX_ENABLE) && defined(MUSIC_RESUME_ENABLE)
+#define LOCAL_MUSIC_RESUME_ENABLE       //断点续播：进模式/插卡直接从上次的曲目和位置接着播，不等扫描
+#endif
+
+#if defined(MUSIC_INDEX_ENABLE) && defined(MUSIC_SEEK_ENABLE) && defined(MUSIC_CACHE_ENABLE)
+#define LOCAL_MUSIC_SEEK_ENABLE         //快进快退按跳转表直接跳到目标帧，经预读缓存跳过中间一段
+#endif
+#define LOCAL_MUSIC_SEEK_STEP       10      //长按上/下键快退/快进的秒数
+
+#if defined(MUSIC_INDEX_ENABLE) && defined(MUSIC_SHUFFLE_ENABLE)
+#define LOCAL_MUSIC_SHUFFLE_ENABLE      //随机播放：按洗好的顺序不重复地播，上一首能回去，下一首可以预开
+#endif
+
+#if defined(LOCAL_MUSIC_GAPLESS_ENABLE) && defined(MUSIC_MIX_ENABLE)
+#define LOCAL_MUSIC_XFADE_ENABLE        //交叉淡化：当前曲目最后几秒就启动预开的下一首，两路增益一降一升
+#define LOCAL_MUSIC_XFADE_SEC       3   //交叉淡化时长，0为不淡化直接无缝切
+#endif
+
+#if defined(MUSIC_INDEX_ENABLE) && defined(MUSIC_MIX_ENABLE) && defined(MUSIC_LOUD_ENABLE)
+#define LOCAL_MUSIC_LOUD_ENABLE         //响度归一化：按索引里每首的增益在混音级统一响度，没测过的首次播放时测
+#endif
+
 struct local_music_hdl {
     u8 local_play_all;	//1:全盘播放 0:播放目录
     char volume;
     u8 reverb_enable;
     u16 wait_sd;
     u16 wait_udisk;
+#ifdef CONFIG_STORE_VOLUME
+    u16 vol_timer;
+#endif
     int play_time;
     int total_time;
+    int time_base;              //跳转后解码器从0计时，加上跳到的秒数
+    u32 skip_from;              //当前曲目打开时跳过的一段，没跳转过为0
+    u32 skip_to;
     FILE *file;
     struct vfscan *fscan;
     struct vfscan *dir_list;
     struct server *dec_server;
     struct audio_dec_breakpoint local_bp;
     const char *local_path;
+#ifdef MUSIC_INDEX_ENABLE
+    struct music_index index;   //卡上的媒体库索引，打开时上下曲/切文件夹不再fscan
+    int track;                  //当前曲目在索引里的序号
+    int dir;                    //当前文件夹在索引里的序号
+    int scan_tried;             //后台建索引时已经试着播过的曲目数
+    u16 scan_timer;
+#endif
+#ifdef LOCAL_MUSIC_GAPLESS_ENABLE
+    struct server *next_server; //和dec_server乒乓使用，预开下一首
+    FILE *next_file;            //已打开并解析完文件头、等待开始的下一首
+    int next_track;
+    int next_total_time;
+    u16 next_timer;
+    FILE *drain_file;           //无缝切歌后还在放输出缓冲的上一首，在next_server上，放完再停
+    u16 drain_timer;
+#endif
+#ifdef LOCAL_MUSIC_SHUFFLE_ENABLE
+    struct music_shuffle shuffle;   //随机播放顺序，order为空时顺序播放
+#endif
+#ifdef MUSIC_MIX_ENABLE
+    u8 mix_in;                  //dec_server用的混音输入，next_server用另一路
+#endif
+#ifdef LOCAL_MUSIC_XFADE_ENABLE
+    u8 xfading;                 //下一首已经启动，正在交叉淡化
+#endif
+#ifdef LOCAL_MUSIC_LOUD_ENABLE
+    int loud_track[MUSIC_MIX_INPUTS];   //每路混音输入正在测响度的曲目，-1不测
+    int loud_pending;                   //无缝切歌时测好的曲目，等预开下一首时再回填，-1没有
+    s16 loud_pending_gain;
+#endif
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+    struct music_resume resume; //当前曲目的断点记录
+    u8 resume_dirty;            //换了曲目还没保存过
+    u8 resume_pending;          //续播的曲目是直接打开的，索引就绪后再定位它的序号
+    u16 resume_timer;
+#endif
 };
 
 static struct local_music_hdl local_music_handler;
@@ -68,6 +153,14 @@ static int local_music_get_dec_breakpoint(struct audio_dec_breakpoint *bp)
     return 0;
 }
 
+#ifdef CONFIG_STORE_VOLUME
+static void local_music_volume_save(void *priv)
+{
+    __this->vol_timer = 0;
+    syscfg_write(CFG_MUSIC_VOL, &__this->volume, sizeof(__this->volume));
+}
+#endif
+
 //设置音量大小
 static int local_music_set_dec_volume(int step)
 {
@@ -89,9 +182,17 @@ static int local_music_set_dec_volume(int step)
     req.dec.cmd     = AUDIO_DEC_SET_VOLUME;
     req.dec.volume  = volume;
     server_request(__this->dec_server, AUDIO_REQ_DEC, &req);
+#ifdef LOCAL_MUSIC_GAPLESS_ENABLE
+    if (__this->next_file) {
+        server_request(__this->next_server, AUDIO_REQ_DEC, &req);
+    }
+#endif
 
 #ifdef CONFIG_STORE_VOLUME
-    syscfg_write(CFG_MUSIC_VOL, &__this->volume, sizeof(__this->volume));
+    if (__this->vol_timer) {
+        sys_timeout_del(__this->vol_timer);
+    }
+    __this->vol_timer = sys_timeout_add(NULL, local_music_volume_save, LOCAL_MUSIC_VOL_SAVE_MS);
 #endif
 
     return 0;
@@ -108,11 +209,82 @@ static int local_music_get_dec_status(void)
     return req.dec.status;
 }
 
+#ifdef LOCAL_MUSIC_LOUD_ENABLE
+//当前曲目在索引里的序号，没有索引或续播的曲目还没定位时为-1
+static int local_music_cur_track(void)
+{
+    if (!__this->index.fp) {
+        return -1;
+    }
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+    if (__this->resume_pending) {
+        return -1;
+    }
+#endif
+    return __this->track;
+}
+
+//测过的曲目按索引里的增益放，没测过的先按原音量放，边放边测
+//旧索引沿用来的增益没按峰值限过，不知道会不会削波，只衰减不放大
+static void local_music_loud_apply(int in, int track)
+{
+    struct music_index_entry e;
+
+    if (track >= 0 && !music_index_read(&__this->index, track, &e) && (e.flags & MUSIC_INDEX_FLAG_GAIN)) {
+        if (!(e.flags & MUSIC_INDEX_FLAG_PEAK) && e.gain > 0) {
+            e.gain = 0;
+        }
+        __this->loud_track[in] = -1;
+        music_mix_level(in, music_loud_gain_q12(e.gain));
+        music_mix_measure(in, 0);
+        return;
+    }
+    __this->loud_track[in] = track;
+    music_mix_level(in, MUSIC_MIX_UNITY);
+    music_mix_measure(in, track >= 0);
+}
+
+//把测好还没回填的增益写进索引
+static void local_music_loud_flush(void)
+{
+    if (__this->loud_pending < 0) {
+        return;
+    }
+    music_index_set_gain(&__this->index, __this->loud_pending, __this->loud_pending_gain);
+    __this->loud_pending = -1;
+}
+
+//曲目放完或被切走、解码器已停后调用：测够了先记下，回填由调用者挑不影响出声的时机
+static void local_music_loud_take(int in)
+{
+    int track = __this->loud_track[in];
+    s16 gain;
+
+    __this->loud_track[in] = -1;
+    if (track < 0 || music_mix_loudness(in, &gain)) {
+        return;
+    }
+    local_music_loud_flush();
+    __this->loud_pending = track;
+    __this->loud_pending_gain = gain;
+}
+#endif
+
+#ifdef LOCAL_MUSIC_XFADE_ENABLE
+static void local_music_next_cancel(void);
+#endif
+
 //暂停/继续播放
 static int local_music_dec_play_pause(void)
 {
     union audio_req r = {0};
 
+#ifdef LOCAL_MUSIC_XFADE_ENABLE
+    //淡化中暂停只停得了当前这首，下一首先收掉，播完时正常切歌
+    if (__this->xfading) {
+        local_music_next_cancel();
+    }
+#endif
 #ifdef CONFIG_DEC_ANALOG_VOLUME_ENABLE
     r.dec.attr = AUDIO_ATTR_FADE_INOUT;
 #endif
@@ -120,12 +292,90 @@ static int local_music_dec_play_pause(void)
     return server_request(__this->dec_server, AUDIO_REQ_DEC, &r);
 }
 
+//关闭交给解码器的文件句柄，可能是包了预读缓存的
+static void local_music_fclose(FILE *file)
+{
+#ifdef MUSIC_CACHE_ENABLE
+    music_cache_fclose(file);
+#else
+    fclose(file);
+#endif
+}
+
+#ifdef LOCAL_MUSIC_GAPLESS_ENABLE
+//丢弃预开的下一首，手动切歌/切文件夹后下一首可能变了
+static void local_music_next_cancel(void)
+{
+    union audio_req req = {0};
+
+    if (__this->next_timer) {
+        sys_timeout_del(__this->next_timer);
+        __this->next_timer = 0;
+    }
+    if (!__this->next_file) {
+        return;
+    }
+    req.dec.cmd = AUDIO_DEC_STOP;
+    server_request(__this->next_server, AUDIO_REQ_DEC, &req);
+#ifdef LOCAL_MUSIC_XFADE_ENABLE
+    //淡化中下一首已经在放，可能已经发过事件；当前曲目拉回原音量
+    if (__this->xfading) {
+        int argv[2];
+        argv[0] = AUDIO_SERVER_EVENT_END;
+        argv[1] = (int)__this->next_file;
+        server_event_handler_del(__this->next_server, 2, argv);
+        music_mix_reset(__this->mix_in);
+        __this->xfading = 0;
+    }
+#endif
+    local_music_fclose(__this->next_file);
+    __this->next_file = NULL;
+}
+
+//停掉无缝切歌时留着放完输出缓冲的上一首，要用next_server或整体停止前也提前收掉
+static void local_music_prev_stop(void)
+{
+    union audio_req req = {0};
+    int argv[2];
+
+    if (__this->drain_timer) {
+        sys_timeout_del(__this->drain_timer);
+        __this->drain_timer = 0;
+    }
+    if (!__this->drain_file) {
+        return;
+    }
+    req.dec.cmd = AUDIO_DEC_STOP;
+    server_request(__this->next_server, AUDIO_REQ_DEC, &req);
+    argv[0] = AUDIO_SERVER_EVENT_END;
+    argv[1] = (int)__this->drain_file;
+    server_event_handler_del(__this->next_server, 2, argv);
+    local_music_fclose(__this->drain_file);
+    __this->drain_file = NULL;
+#ifdef LOCAL_MUSIC_LOUD_ENABLE
+    //上一首用的是另一路混音输入，解码器停了再取结果
+    local_music_loud_take(!__this->mix_in);
+#endif
+}
+
+static void local_music_prev_drained(void *priv)
+{
+    __this->drain_timer = 0;
+    local_music_prev_stop();
+}
+#endif
+
 //停止播放
 static int local_music_dec_stop(void)
 {
     int err = 0;
     union audio_req req = {0};
 
+#ifdef LOCAL_MUSIC_GAPLESS_ENABLE
+    local_music_next_cancel();
+    local_music_prev_stop();
+#endif
+
     if (!__this->file) {
         return 0;
     }
@@ -134,67 +384,111 @@ static int local_music_dec_stop(void)
 
     req.dec.cmd = AUDIO_DEC_STOP;
     server_request(__this->dec_server, AUDIO_REQ_DEC, &req);
+#ifdef LOCAL_MUSIC_LOUD_ENABLE
+    //解码回调停了再取结果
+    local_music_loud_take(__this->mix_in);
+    local_music_loud_flush();
+#endif
 
     int argv[2];
     argv[0] = AUDIO_SERVER_EVENT_END;
     argv[1] = (int)__this->file;
     server_event_handler_del(__this->dec_server, 2, argv);
 
-    fclose(__this->file);
+    local_music_fclose(__this->file);
     __this->file = NULL;
 
     return 0;
 }
 
-//解码文件
-static int local_music_dec_file(FILE *file)
+//打开解码器并解析文件头，还不输出，req由调用者清零
+//交给解码器的句柄在req->dec.file里，之后用它关闭；文件里[skip_from, skip_to)不交给解码器
+static int local_music_dec_open(struct server *server, FILE *file, u32 skip_from, u32 skip_to, union audio_req *req)
 {
+#ifdef MUSIC_CACHE_ENABLE
+    struct music_cache *cache;
+#endif
+#ifdef MUSIC_MIX_ENABLE
+    int in;
+#endif
     int err;
-    union audio_req req = {0};
 
-    log_i("local_music_dec_local_file\n");
-
-    if (!file) {
-        return -1;
-    }
-
-    local_music_dec_stop();
-
-    req.dec.cmd             = AUDIO_DEC_OPEN;
-    req.dec.volume          = __this->volume;
-    req.dec.output_buf_len  = 6 * 1024;
-    req.dec.file            = file;
-    req.dec.channel         = 0;
-    req.dec.sample_rate     = 0;
-    req.dec.priority        = 1;
-    req.dec.sample_source   = CONFIG_AUDIO_DEC_PLAY_SOURCE;
+    req->dec.cmd             = AUDIO_DEC_OPEN;
+    req->dec.volume          = __this->volume;
+    req->dec.output_buf_len  = LOCAL_MUSIC_DEC_BUF_LEN;
+    req->dec.file            = file;
+    req->dec.channel         = 0;
+    req->dec.sample_rate     = 0;
+    req->dec.priority        = 1;
+    req->dec.sample_source   = CONFIG_AUDIO_DEC_PLAY_SOURCE;
 #if 0	//变声变调功能
-    req.dec.speedV = 80; // >80是变快，<80是变慢，建议范围：30到130
-    req.dec.pitchV = 32768; // >32768是音调变高，<32768音调变低，建议范围20000到50000
-    req.dec.attr = AUDIO_ATTR_PS_EN;
+    req->dec.speedV = 80; // >80是变快，<80是变慢，建议范围：30到130
+    req->dec.pitchV = 32768; // >32768是音调变高，<32768音调变低，建议范围20000到50000
+    req->dec.attr = AUDIO_ATTR_PS_EN;
 #endif
 
 #if TCFG_EQ_ENABLE && defined EQ_CORE_V1
-    req.dec.attr |= AUDIO_ATTR_EQ_EN;
+    req->dec.attr |= AUDIO_ATTR_EQ_EN;
 #if TCFG_LIMITER_ENABLE
-    req.dec.attr |= AUDIO_ATTR_EQ32BIT_EN;
+    req->dec.attr |= AUDIO_ATTR_EQ32BIT_EN;
 #endif
 #if TCFG_DRC_ENABLE
-    req.dec.attr |= AUDIO_ATTR_DRC_EN;
+    req->dec.attr |= AUDIO_ATTR_DRC_EN;
 #endif
 #endif
 
 #if CONFIG_DEC_DECRYPT_ENABLE
     //播放加密文件
     extern const struct audio_vfs_ops *get_decrypt_vfs_ops(void);
-    req.dec.vfs_ops = get_decrypt_vfs_ops();
-    req.dec.attr |= AUDIO_ATTR_DECRYPT_DEC;
+    req->dec.vfs_ops = get_decrypt_vfs_ops();
+    req->dec.attr |= AUDIO_ATTR_DECRYPT_DEC;
 #endif
 
-    err = server_request(__this->dec_server, AUDIO_REQ_DEC, &req);
+#ifdef MUSIC_MIX_ENABLE
+    //两个解码器各占一路混音输入，跟着server走，新曲目从原音量开始
+    in = server == __this->dec_server ? __this->mix_in : !__this->mix_in;
+    music_mix_reset(in);
+    req->dec.dec_callback = music_mix_callback(in);
+#endif
+#ifdef LOCAL_MUSIC_LOUD_ENABLE
+    local_music_loud_apply(in, server == __this->dec_server ? local_music_cur_track() : __this->next_track);
+#endif
+
+#ifdef MUSIC_CACHE_ENABLE
+    //解码器经预读缓存读卡，解密vfs接在缓存下面
+    cache = music_cache_open(file, req->dec.vfs_ops, skip_from, skip_to);
+    if (cache) {
+        req->dec.file = (FILE *)cache;
+        req->dec.vfs_ops = &music_cache_vfs_ops;
+    }
+#endif
+
+    err = server_request(server, AUDIO_REQ_DEC, req);
     if (err) {
         log_e("audio_dec_open: err = %d\n", err);
-        fclose(file);
+    }
+
+    return err;
+}
+
+//解码文件，bp不为空时从断点开始
+static int local_music_dec_file(FILE *file, struct audio_dec_breakpoint *bp, u32 skip_from, u32 skip_to)
+{
+    int err;
+    union audio_req req = {0};
+
+    log_i("local_music_dec_local_file\n");
+
+    if (!file) {
+        return -1;
+    }
+
+    local_music_dec_stop();
+
+    req.dec.bp = bp;
+    err = local_music_dec_open(__this->dec_server, file, skip_from, skip_to, &req);
+    if (err) {
+        local_music_fclose(req.dec.file);
         return err;
     }
 
@@ -206,17 +500,528 @@ static int local_music_dec_file(FILE *file)
     err = server_request(__this->dec_server, AUDIO_REQ_DEC, &req);
     if (err) {
         log_e("audio_dec_start: err = %d\n", err);
-        fclose(file);
+        local_music_fclose(req.dec.file);
         return err;
     }
 
-    __this->file = file;
+    __this->file = req.dec.file;
+    __this->time_base = 0;
+    __this->skip_from = skip_from;
+    __this->skip_to = skip_to;
 
     log_i("play_music_file: suss\n");
 
     return 0;
 }
 
+#ifdef MUSIC_INDEX_ENABLE
+static void local_music_track_started(void);
+#if defined(LOCAL_MUSIC_SHUFFLE_ENABLE) && defined(LOCAL_MUSIC_RESUME_ENABLE)
+static void local_music_shuffle_restore(void);
+#endif
+
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+//记下当前曲目的完整路径，断点续播开机时直接打开
+static void local_music_resume_set_track(void)
+{
+    struct music_resume *r = &__this->resume;
+    struct music_index_entry e;
+    int root_len = strlen(__this->local_path);
+
+    r->path_len = 0;
+    if (music_index_read(&__this->index, __this->track, &e) ||
+        root_len + e.path_len + 2 > MUSIC_RESUME_PATH_MAX) {
+        return;
+    }
+    memset(r->path, 0, sizeof(r->path));
+    memcpy(r->path, __this->local_path, root_len);
+    memcpy(r->path + root_len, e.path, e.path_len);
+    r->path_len = root_len + e.path_len;
+    r->sclust = e.sclust;
+    r->size = e.size;
+    r->track = __this->track;
+    r->bp_len = 0;
+    r->bp_fptr = 0;
+    r->skip_from = __this->skip_from;
+    r->skip_to = __this->skip_to;
+    r->time_base = __this->time_base;
+#ifdef LOCAL_MUSIC_SHUFFLE_ENABLE
+    r->shuffle_seed = __this->shuffle.order ? __this->shuffle.seed : 0;
+    r->shuffle_first = __this->shuffle.first;
+    r->shuffle_count = __this->shuffle.count;
+    r->shuffle_anchor = __this->shuffle.anchor;
+    r->shuffle_pos = __this->shuffle.pos;
+#endif
+    __this->resume_dirty = 1;
+}
+
+//取解码器断点写入flash，暂停中位置没变不写
+static void local_music_resume_save(void)
+{
+    struct music_resume *r = &__this->resume;
+    struct audio_dec_breakpoint *bp = &__this->local_bp;
+    int len = 0;
+
+    //换曲后还没记下新曲目的路径；续播的曲目还没定位时记录就是它本身
+    if (!__this->file || !r->path_len || (r->track != __this->track && !__this->resume_pending)) {
+        return;
+    }
+    if (!local_music_get_dec_breakpoint(bp) && bp->len <= MUSIC_RESUME_BP_MAX) {
+        len = bp->len;
+    }
+    if (!__this->resume_dirty && r->bp_len == len &&
+        (!len || (r->bp_fptr == bp->fptr && !memcmp(r->bp_data, bp->data, len)))) {
+        return;
+    }
+    r->bp_len = len;
+    r->bp_fptr = len ? bp->fptr : 0;
+    if (len) {
+        memcpy(r->bp_data, bp->data, len);
+    }
+    if (!music_resume_save(r)) {
+        __this->resume_dirty = 0;
+    }
+}
+
+static void local_music_resume_tick(void *priv)
+{
+    local_music_resume_save();
+}
+
+//不等索引和扫描，按上次的记录直接打开文件从断点接着播
+static int local_music_resume_play(const char *root)
+{
+    struct music_resume *r = &__this->resume;
+    struct audio_dec_breakpoint *bp = &__this->local_bp;
+    struct vfs_attr attr = {0};
+    FILE *file;
+
+    if (music_resume_load(r) || strncmp(r->path, root, strlen(root))) {
+        return -1;
+    }
+    file = fopen(r->path, "r");
+    if (!file) {
+        return -1;
+    }
+    //同名文件被换过就不续播
+    fget_attrs(file, &attr);
+    if (attr.sclust != r->sclust || attr.fsize != r->size) {
+        fclose(file);
+        return -1;
+    }
+
+    if (bp->data) {
+        free(bp->data);
+        bp->data = NULL;
+    }
+    bp->len = 0;
+    if (r->bp_len) {
+        bp->data = malloc(r->bp_len);
+        if (bp->data) {
+            memcpy(bp->data, r->bp_data, r->bp_len);
+            bp->len = r->bp_len;
+            bp->fptr = r->bp_fptr;
+        }
+    }
+
+    __this->track = r->track;
+    if (local_music_dec_file(file, bp->len ? bp : NULL, r->skip_from, r->skip_to)) {
+        //断点数据和解码器对不上时从头播
+        file = fopen(r->path, "r");
+        if (!file || local_music_dec_file(file, NULL, 0, 0)) {
+            return -1;
+        }
+    } else {
+        __this->time_base = r->time_base;
+        __this->play_time += r->time_base;
+    }
+    log_i("resume track %d at %d\n", r->track + 1, r->bp_fptr);
+
+    return 0;
+}
+
+//索引就绪后找回续播曲目的序号，上下曲和预开下一首从这里接着走
+static void local_music_resume_locate(void)
+{
+    struct music_resume *r = &__this->resume;
+    int track = music_index_find(&__this->index, r->sclust, r->size, r->track);
+
+    if (track < 0) {
+        //索引里没有这首：接着放完，序号不可信就不往索引和断点里回填，放完从范围开头按索引播
+        log_w("resume track not in index\n");
+        __this->track = -1;
+        return;
+    }
+    __this->track = track;
+    __this->dir = music_index_dir_of(&__this->index, __this->track);
+    r->track = __this->track;
+#ifdef LOCAL_MUSIC_SHUFFLE_ENABLE
+    local_music_shuffle_restore();
+#endif
+    local_music_track_started();
+}
+#endif
+
+//在[first, first+count)范围内按fselect的方式选下一个序号
+static int local_music_index_select(int cur, int first, int count, int fsel_mode)
+{
+    switch (fsel_mode) {
+    case FSEL_FIRST_FILE:
+        return first;
+    case FSEL_LAST_FILE:
+        return first + count - 1;
+    case FSEL_PREV_FILE:
+        return (cur <= first || cur >= first + count) ? first + count - 1 : cur - 1;
+    case FSEL_BY_NUMBER:
+        return first + CPU_RAND() % count;
+    default:
+        return (cur < first || cur + 1 >= first + count) ? first : cur + 1;
+    }
+}
+
+//当前的播放范围：全盘或当前文件夹
+static void local_music_index_range(int *first, int *count)
+{
+    *first = 0;
+    *count = __this->index.hdr.track_count;
+    if (!__this->local_play_all) {
+        music_index_dir_range(&__this->index, __this->dir, first, count);
+    }
+}
+
+//选下一个要播的序号，随机播放时按洗好的顺序走，范围变了(切文件夹)重新洗
+static int local_music_index_pick(int cur, int first, int count, int fsel_mode)
+{
+#ifdef LOCAL_MUSIC_SHUFFLE_ENABLE
+    struct music_shuffle *sh = &__this->shuffle;
+    int track;
+
+    if (sh->order && (sh->first != first || sh->count != count)) {
+        music_shuffle_init(sh, first, count, CPU_RAND(), -1);
+    }
+    if (sh->order) {
+        if (fsel_mode == FSEL_PREV_FILE || fsel_mode == FSEL_LAST_FILE) {
+            track = music_shuffle_prev(sh);
+        } else {
+            track = music_shuffle_next(sh);
+        }
+        //已经退到这一轮的第一首时按顺序往前
+        if (track >= 0) {
+            return track;
+        }
+    }
+#endif
+    return local_music_index_select(cur, first, count, fsel_mode);
+}
+
+#ifdef LOCAL_MUSIC_SHUFFLE_ENABLE
+//随机播放开关，打开时当前曲目算新一轮的第一首
+static int local_music_shuffle_toggle(void)
+{
+    int first, count;
+
+    if (!__this->index.fp) {
+        return -1;
+    }
+    if (__this->shuffle.order) {
+        music_shuffle_free(&__this->shuffle);
+    } else {
+        local_music_index_range(&first, &count);
+        if (music_shuffle_init(&__this->shuffle, first, count, CPU_RAND(), __this->track)) {
+            return -1;
+        }
+    }
+    log_i("local music shuffle %s\n", __this->shuffle.order ? "on" : "off");
+
+#ifdef LOCAL_MUSIC_GAPLESS_ENABLE
+    //预开的下一首是按旧顺序选的
+    local_music_next_cancel();
+#endif
+    if (__this->file) {
+        local_music_track_started();
+    }
+    return 0;
+}
+
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+//按断点记录恢复随机顺序，索引重建过范围对不上就从当前曲目重新开一轮
+static void local_music_shuffle_restore(void)
+{
+    struct music_resume *r = &__this->resume;
+    int first, count;
+
+    if (!r->shuffle_seed) {
+        return;
+    }
+    local_music_index_range(&first, &count);
+    if (r->shuffle_first == first && r->shuffle_count == count &&
+        !music_shuffle_init(&__this->shuffle, first, count, r->shuffle_seed, r->shuffle_anchor)) {
+        //记录时已经洗好下一轮(pos为-1)就从新一轮开头接着走
+        if (r->shuffle_pos >= 0) {
+            music_shuffle_locate(&__this->shuffle, r->shuffle_pos, __this->track);
+        }
+        return;
+    }
+    music_shuffle_init(&__this->shuffle, first, count, r->shuffle_seed, __this->track);
+}
+#endif
+#endif
+
+//曲目开始后不急的事，无缝切歌时推迟到预开下一首时做，边界上不读写卡
+static void local_music_track_update(void)
+{
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+    //续播的曲目还没在索引里定位到，序号不可信
+    if (__this->resume_pending) {
+        return;
+    }
+#endif
+    if (__this->total_time > 0) {
+        music_index_set_duration(&__this->index, __this->track, __this->total_time * 1000);
+    }
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+    local_music_resume_set_track();
+#endif
+}
+
+#ifdef LOCAL_MUSIC_GAPLESS_ENABLE
+//播放范围内当前曲目的下一首
+static int local_music_index_next_track(void)
+{
+    int first, count;
+
+    local_music_index_range(&first, &count);
+    if (count <= 0) {
+        return -1;
+    }
+    //后台还在建索引时范围只是已扫到的部分：不绕回开头，随机顺序也还没定，都不预开，播完时正常切歌
+    if (__this->scan_timer &&
+        (__this->track + 1 >= first + count
+#ifdef LOCAL_MUSIC_SHUFFLE_ENABLE
+         || __this->shuffle.order
+#endif
+        )) {
+        return -1;
+    }
+#ifdef LOCAL_MUSIC_SHUFFLE_ENABLE
+    if (__this->shuffle.order && __this->shuffle.first == first && __this->shuffle.count == count) {
+        return music_shuffle_peek(&__this->shuffle);
+    }
+#endif
+    return local_music_index_select(__this->track, first, count, FSEL_NEXT_FILE);
+}
+
+//开始播放后延时执行：回填时长，在空闲的解码器上打开下一首并解析文件头
+static void local_music_next_preload(void *priv)
+{
+    union audio_req req = {0};
+    FILE *file;
+    int track;
+
+    __this->next_timer = 0;
+    if (!__this->file) {
+        return;
+    }
+    local_music_track_update();
+    //上一首的输出缓冲早该放完了，下一首要用它的解码器
+    local_music_prev_stop();
+#ifdef LOCAL_MUSIC_LOUD_ENABLE
+    //上一首的响度在切歌边界上只记下，这里和回填时长一起写卡
+    local_music_loud_flush();
+#endif
+    if (__this->next_file || !__this->next_server) {
+        return;
+    }
+
+    //坏文件不预开，播完时正常切歌会跳过它
+    track = local_music_index_next_track();
+    if (track < 0 || music_index_is_bad(&__this->index, track)) {
+        return;
+    }
+    file = music_index_fopen(&__this->index, track);
+    if (!file) {
+        return;
+    }
+    __this->next_track = track;
+    if (local_music_dec_open(__this->next_server, file, 0, 0, &req)) {
+        //打不开的留给播完时正常切歌去跳过
+        req.dec.cmd = AUDIO_DEC_STOP;
+        server_request(__this->next_server, AUDIO_REQ_DEC, &req);
+        local_music_fclose(req.dec.file);
+        return;
+    }
+    __this->next_file = req.dec.file;
+    __this->next_total_time = req.dec.total_time;
+    log_i("preload track %d\n", track + 1);
+}
+
+//当前曲目解码结束，直接启动预开好的下一首，边界上不读卡；
+//上一首的输出缓冲里还有没放完的，不马上停，放完再停解码器、关文件
+static int local_music_next_handover(void)
+{
+    union audio_req req = {0};
+    struct server *prev_server = __this->dec_server;
+    FILE *prev_file = __this->file;
+
+    if (!__this->next_file) {
+        return -1;
+    }
+#ifdef LOCAL_MUSIC_XFADE_ENABLE
+    //淡化时已经启动过
+    if (!__this->xfading) {
+#endif
+        req.dec.cmd = AUDIO_DEC_START;
+        if (server_request(__this->next_server, AUDIO_REQ_DEC, &req)) {
+            local_music_next_cancel();
+            return -1;
+        }
+#ifdef LOCAL_MUSIC_XFADE_ENABLE
+    }
+    __this->xfading = 0;
+#endif
+#ifdef MUSIC_MIX_ENABLE
+    __this->mix_in = !__this->mix_in;
+#endif
+
+    __this->dec_server = __this->next_server;
+    __this->next_server = prev_server;
+    __this->file = __this->next_file;
+    __this->next_file = NULL;
+    __this->track = __this->next_track;
+    __this->dir = music_index_dir_of(&__this->index, __this->track);
+#ifdef LOCAL_MUSIC_SHUFFLE_ENABLE
+    //预开时只看了一眼，这里真正走到下一首
+    if (__this->shuffle.order && music_shuffle_peek(&__this->shuffle) == __this->track) {
+        music_shuffle_next(&__this->shuffle);
+    }
+#endif
+    __this->play_time = 0;
+    __this->total_time = __this->next_total_time;
+    __this->time_base = 0;
+    __this->skip_from = 0;
+    __this->skip_to = 0;
+
+    __this->drain_file = prev_file;
+    __this->drain_timer = sys_timeout_add(NULL, local_music_prev_drained, LOCAL_MUSIC_DRAIN_MS);
+
+    log_i("gapless to track %d\n", __this->track + 1);
+    local_music_track_started();
+
+    return 0;
+}
+
+#ifdef LOCAL_MUSIC_XFADE_ENABLE
+//当前曲目还剩淡化时长时启动预开好的下一首，两路在混音级一降一升，收尾仍走handover
+static void local_music_xfade_check(void)
+{
+    union audio_req req = {0};
+    int next_in = !__this->mix_in;
+
+    if (LOCAL_MUSIC_XFADE_SEC == 0 || __this->xfading || !__this->next_file || !__this->total_time ||
+        __this->play_time + LOCAL_MUSIC_XFADE_SEC < __this->total_time) {
+        return;
+    }
+    music_mix_fade(next_in, 0, 0);
+    req.dec.cmd = AUDIO_DEC_START;
+    if (server_request(__this->next_server, AUDIO_REQ_DEC, &req)) {
+        local_music_next_cancel();
+        return;
+    }
+    music_mix_fade(next_in, MUSIC_MIX_UNITY, LOCAL_MUSIC_XFADE_SEC * 1000);
+    music_mix_fade(__this->mix_in, 0, LOCAL_MUSIC_XFADE_SEC * 1000);
+    __this->xfading = 1;
+    log_i("crossfade to track %d\n", __this->next_track + 1);
+}
+#endif
+#endif
+
+//按索引切歌，记过坏文件的不再打开，打开失败的顺延，最多把范围内的曲目试一遍；
+//文件打不开说明索引过时了，记下来下次重建；解码器打不开的不一定是文件坏，不记坏文件，
+//坏文件只认解码器开播后报的错
+static int local_music_index_switch_file(int fsel_mode)
+{
+    struct music_index *ix = &__this->index;
+    int first, count;
+    int track = __this->track;
+    FILE *file;
+
+    local_music_index_range(&first, &count);
+    if (count <= 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        track = local_music_index_pick(track, first, count, fsel_mode);
+        if (fsel_mode == FSEL_FIRST_FILE) {
+            fsel_mode = FSEL_NEXT_FILE;
+        } else if (fsel_mode == FSEL_LAST_FILE) {
+            fsel_mode = FSEL_PREV_FILE;
+        }
+        if (music_index_is_bad(ix, track)) {
+            continue;
+        }
+        file = music_index_fopen(ix, track);
+        if (!file) {
+            music_index_invalidate(ix);
+            continue;
+        }
+        __this->track = track;
+        if (0 == local_music_dec_file(file, NULL, 0, 0)) {
+            log_i("play track %d/%d\n", track + 1, ix->hdr.track_count);
+            __this->dir = music_index_dir_of(ix, track);
+            local_music_track_started();
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+//新曲目开始出声
+static void local_music_track_started(void)
+{
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+    //已经按索引换过曲目，续播的那首不用再定位
+    __this->resume_pending = 0;
+#endif
+#ifdef LOCAL_MUSIC_GAPLESS_ENABLE
+    __this->next_timer = sys_timeout_add(NULL, local_music_next_preload, LOCAL_MUSIC_PRELOAD_DELAY_MS);
+#else
+    local_music_track_update();
+#endif
+}
+
+//按索引切文件夹，跳过空文件夹
+static int local_music_index_switch_dir(int fsel_mode)
+{
+    struct music_index *ix = &__this->index;
+    int dir = __this->dir;
+    int first, count;
+
+    if (__this->local_play_all) {
+        return local_music_index_switch_file(FSEL_FIRST_FILE);
+    }
+
+    for (int i = 0; i < ix->hdr.dir_count; i++) {
+        dir = local_music_index_select(dir, 0, ix->hdr.dir_count, fsel_mode);
+        if (fsel_mode == FSEL_FIRST_FILE) {
+            fsel_mode = FSEL_NEXT_FILE;
+        } else if (fsel_mode == FSEL_LAST_FILE) {
+            fsel_mode = FSEL_PREV_FILE;
+        }
+        if (music_index_dir_range(ix, dir, &first, &count) || count == 0) {
+            continue;
+        }
+        __this->dir = dir;
+        log_i("switch dir %d, %d tracks\n", dir, count);
+        return local_music_index_switch_file(FSEL_FIRST_FILE);
+    }
+    log_w("no_music_dir_find\n");
+
+    return -1;
+}
+#endif
+
 //切换上一首或下一首
 static int local_music_dec_switch_file(int fsel_mode)
 {
@@ -227,6 +1032,12 @@ static int local_music_dec_switch_file(int fsel_mode)
 
     log_i("local_music_dec_switch_file\n");
 
+#ifdef MUSIC_INDEX_ENABLE
+    if (__this->index.fp) {
+        return local_music_index_switch_file(fsel_mode);
+    }
+#endif
+
     if (!__this->fscan || !__this->fscan->file_number) {
         return -1;
     }
@@ -256,7 +1067,7 @@ __retry:
         return -1;
     }
 
-    if (0 != local_music_dec_file(file)) {
+    if (0 != local_music_dec_file(file, NULL, 0, 0)) {
         if (fsel_mode == FSEL_FIRST_FILE) {
             fsel_mode = FSEL_NEXT_FILE;
         } else if (fsel_mode == FSEL_LAST_FILE) {
@@ -286,6 +1097,12 @@ static int local_music_dec_switch_dir(int fsel_mode)
         return -1;
     }
 
+#ifdef MUSIC_INDEX_ENABLE
+    if (__this->index.fp) {
+        return local_music_index_switch_dir(fsel_mode);
+    }
+#endif
+
     if (__this->local_play_all && __this->local_path != CONFIG_MUSIC_PATH_FLASH) {
         //全盘搜索
         if (__this->fscan) {
@@ -389,7 +1206,48 @@ __again:
     return 0;
 }
 
-//快进快退,单位是秒,暂时只支持MP3格式
+#ifdef LOCAL_MUSIC_SEEK_ENABLE
+//按跳转表重新打开当前曲目：解码器读完文件头直接接着读目标帧，不用逐帧快进
+static int local_music_dec_jump(int sec)
+{
+    struct music_index_entry e;
+    struct music_seek_pos pos;
+    int total_time = __this->total_time;
+    FILE *file;
+
+    if (!__this->index.fp || !__this->file ||
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+        __this->resume_pending ||
+#endif
+        music_index_read(&__this->index, __this->track, &e) ||
+        music_seek_lookup(__this->local_path, __this->track, e.sclust, e.size, sec * 1000, &pos)) {
+        return -1;
+    }
+    file = music_index_fopen(&__this->index, __this->track);
+    if (!file) {
+        return -1;
+    }
+    if (local_music_dec_file(file, NULL, pos.hdr_len, pos.offset)) {
+        //跳过去打不开，从头播这首
+        file = music_index_fopen(&__this->index, __this->track);
+        if (!file || local_music_dec_file(file, NULL, 0, 0)) {
+            return -1;
+        }
+        local_music_track_started();
+        return 0;
+    }
+    //解码器按剩下的长度算时长，总时长沿用跳转前的
+    __this->time_base = pos.time_ms / 1000;
+    __this->play_time = __this->time_base;
+    __this->total_time = total_time;
+    local_music_track_started();
+    log_i("local music jump to %ds, offset %d\n", __this->time_base, pos.offset);
+
+    return 0;
+}
+#endif
+
+//快进快退,单位是秒；有跳转表的曲目直接跳，其余交给解码器快进，只支持MP3格式
 static int local_music_dec_seek(int seek_step)
 {
     union audio_req r = {0};
@@ -405,6 +1263,12 @@ static int local_music_dec_seek(int seek_step)
         }
     }
 
+#ifdef LOCAL_MUSIC_SEEK_ENABLE
+    if (0 == local_music_dec_jump(__this->play_time + seek_step)) {
+        return 0;
+    }
+#endif
+
     if (seek_step > 0) {
         r.dec.cmd = AUDIO_DEC_FF;
         r.dec.ff_fr_step = seek_step;
@@ -418,6 +1282,62 @@ static int local_music_dec_seek(int seek_step)
     return server_request(__this->dec_server, AUDIO_REQ_DEC, &r);
 }
 
+#ifdef MUSIC_INDEX_ENABLE
+//索引完整可用：找回续播曲目的序号、恢复随机顺序、开始扫跳转表，还没在播就从第一首开始
+static int local_music_index_ready(void)
+{
+#ifdef MUSIC_SEEK_ENABLE
+    music_seek_start(&__this->index);
+#endif
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+    if (__this->resume_pending) {
+        local_music_resume_locate();
+        return 0;
+    }
+#ifdef LOCAL_MUSIC_SHUFFLE_ENABLE
+    //没能续播，上次是随机播放的话新开一轮
+    if (!__this->shuffle.order && __this->resume.shuffle_seed) {
+        int first, count;
+        local_music_index_range(&first, &count);
+        music_shuffle_init(&__this->shuffle, first, count, CPU_RAND(), -1);
+    }
+#endif
+#endif
+    if (!__this->file) {
+        return local_music_dec_switch_dir(FSEL_FIRST_FILE);
+    }
+    return 0;
+}
+
+//后台建索引时轮询：扫到能播的曲目就先播，建完再做要完整索引的事
+static void local_music_scan_tick(void *priv)
+{
+    if (music_index_building(&__this->index)) {
+        if (!__this->file && __this->index.hdr.track_count > __this->scan_tried) {
+            __this->scan_tried = __this->index.hdr.track_count;
+            local_music_dec_switch_dir(FSEL_FIRST_FILE);
+        }
+        return;
+    }
+    sys_timer_del(__this->scan_timer);
+    __this->scan_timer = 0;
+
+    if (__this->index.fp) {
+        local_music_index_ready();
+        return;
+    }
+    log_w("music index unavailable, use fscan\n");
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+    if (__this->resume_pending) {
+        return;
+    }
+#endif
+    if (!__this->file) {
+        local_music_dec_switch_dir(FSEL_FIRST_FILE);
+    }
+}
+#endif
+
 //释放资源，切换播放源设备
 static int local_music_switch_local_device(const char *path)
 {
@@ -440,7 +1360,28 @@ static int local_music_switch_local_device(const char *path)
         __this->wait_udisk = 0;
     }
 
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+    local_music_resume_save();
+    __this->resume_pending = 0;
+#endif
     local_music_dec_stop();
+#ifdef MUSIC_SEEK_ENABLE
+    music_seek_stop();
+#endif
+#ifdef MUSIC_INDEX_ENABLE
+    if (__this->scan_timer) {
+        sys_timer_del(__this->scan_timer);
+        __this->scan_timer = 0;
+    }
+    //后台还在建索引时中止，拔卡不用等扫完
+    music_index_close(&__this->index);
+    __this->track = 0;
+    __this->dir = 0;
+    __this->scan_tried = 0;
+#endif
+#ifdef LOCAL_MUSIC_SHUFFLE_ENABLE
+    music_shuffle_free(&__this->shuffle);
+#endif
 
     if (path == NULL) {
         return -1;
@@ -448,6 +1389,37 @@ static int local_music_switch_local_device(const char *path)
 
     __this->local_path = path;
 
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+    //先出声，再检查/重建索引
+    if (path != CONFIG_MUSIC_PATH_FLASH) {
+        __this->resume_pending = !local_music_resume_play(path);
+    }
+#endif
+
+#ifdef MUSIC_INDEX_ENABLE
+    //内置flash的资源目录只读且文件少，仍用fscan
+    if (path != CONFIG_MUSIC_PATH_FLASH) {
+        if (0 == music_index_open(&__this->index, path)) {
+            return local_music_index_ready();
+        }
+        //卡上内容变了，后台重建索引，扫到第一首就开始播，按键和播放不用等
+        if (0 == music_index_build_start(&__this->index, path)) {
+            __this->scan_timer = sys_timer_add(NULL, local_music_scan_tick, LOCAL_MUSIC_SCAN_POLL_MS);
+            return 0;
+        }
+        if (0 == music_index_build(&__this->index, path)) {
+            return local_music_index_ready();
+        }
+        log_w("music index unavailable, use fscan\n");
+    }
+#endif
+
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+    if (__this->resume_pending) {
+        return 0;
+    }
+#endif
+
     local_music_dec_switch_dir(FSEL_FIRST_FILE);
 
     return 0;
@@ -458,14 +1430,55 @@ static void dec_server_event_handler(void *priv, int argc, int *argv)
     switch (argv[0]) {
     case AUDIO_SERVER_EVENT_ERR:
         log_i("local_music: AUDIO_SERVER_EVENT_ERR\n");
+#ifdef LOCAL_MUSIC_GAPLESS_ENABLE
+        //预开或淡化中的下一首出错：收掉它(淡化中当前曲目拉回原音量)，当前曲目播完时正常切歌
+        if (__this->next_file && argv[1] == (int)__this->next_file) {
+            local_music_next_cancel();
+            break;
+        }
+#endif
+#ifdef MUSIC_INDEX_ENABLE
+        //刚开播就出错的多半是文件本身坏了，记下来以后不再打开
+        if (argv[1] == (int)__this->file && __this->index.fp &&
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+            !__this->resume_pending &&
+#endif
+            __this->play_time - __this->time_base < LOCAL_MUSIC_BAD_ERR_SEC) {
+            music_index_set_bad(&__this->index, __this->track);
+        }
+#endif
     case AUDIO_SERVER_EVENT_END:
         log_i("local_music: AUDIO_SERVER_EVENT_END\n");
+#ifdef LOCAL_MUSIC_GAPLESS_ENABLE
+        //两个解码器共用这个回调，只处理当前曲目的结束
+        if (argv[1] != (int)__this->file) {
+            break;
+        }
+        if (0 == local_music_next_handover()) {
+            break;
+        }
+#endif
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+        //续播的曲目是直接打开的，没有索引时还没扫描过
+        if (!__this->index.fp && !__this->fscan) {
+            local_music_dec_stop();
+            local_music_dec_switch_dir(FSEL_FIRST_FILE);
+            break;
+        }
+#endif
         local_music_dec_stop();
         local_music_dec_switch_file(FSEL_NEXT_FILE);
         break;
     case AUDIO_SERVER_EVENT_CURR_TIME:
+        //淡化时两个解码器都在报时间，只要当前曲目的
+        if (priv != __this->dec_server) {
+            break;
+        }
         log_d("play_time: %d\n", argv[1]);
-        __this->play_time = argv[1];
+        __this->play_time = argv[1] + __this->time_base;
+#ifdef LOCAL_MUSIC_XFADE_ENABLE
+        local_music_xfade_check();
+#endif
         break;
     }
 }
@@ -501,7 +1514,7 @@ static int vfs_local_repeat_play()
     union audio_req req = {0};
     req.dec.cmd             = AUDIO_DEC_OPEN;
     req.dec.volume          =  80;
-    req.dec.output_buf_len  = 6 * 1024;
+    req.dec.output_buf_len  = LOCAL_MUSIC_DEC_BUF_LEN;
     req.dec.file            = __this->file;
     req.dec.dec_type        = "mp3";
     req.dec.channel         = 0;
@@ -543,6 +1556,12 @@ static int local_music_mode_init(void)
     log_i("local_music_play_main\n");
 
     memset(__this, 0, sizeof(struct local_music_hdl));
+#ifdef LOCAL_MUSIC_LOUD_ENABLE
+    for (int i = 0; i < MUSIC_MIX_INPUTS; i++) {
+        __this->loud_track[i] = -1;
+    }
+    __this->loud_pending = -1;
+#endif
 
 #ifdef CONFIG_STORE_VOLUME
     if (syscfg_read(CFG_MUSIC_VOL, &__this->volume, sizeof(__this->volume)) < 0 ||
@@ -561,7 +1580,16 @@ static int local_music_mode_init(void)
     if (!__this->dec_server) {
         return -1;
     }
-    server_register_event_handler_to_task(__this->dec_server, NULL, dec_server_event_handler, "app_core");
+    server_register_event_handler_to_task(__this->dec_server, __this->dec_server, dec_server_event_handler, "app_core");
+#ifdef LOCAL_MUSIC_GAPLESS_ENABLE
+    __this->next_server = server_open("audio_server", "dec");
+    if (__this->next_server) {
+        server_register_event_handler_to_task(__this->next_server, __this->next_server, dec_server_event_handler, "app_core");
+    }
+#endif
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+    __this->resume_timer = sys_timer_add(NULL, local_music_resume_tick, MUSIC_RESUME_SAVE_SEC * 1000);
+#endif
 
     if (storage_device_ready()) {
 #ifndef VFS_SD_TEST
@@ -576,14 +1604,36 @@ static int local_music_mode_init(void)
 
 static void local_music_mode_exit(void)
 {
+#ifdef CONFIG_STORE_VOLUME
+    if (__this->vol_timer) {
+        sys_timeout_del(__this->vol_timer);
+        local_music_volume_save(NULL);
+    }
+#endif
 #if defined CONFIG_REVERB_MODE_ENABLE && defined CONFIG_AUDIO_MIX_ENABLE
     if (__this->reverb_enable) {
         echo_reverb_uninit();
     }
+#endif
+#ifdef LOCAL_MUSIC_RESUME_ENABLE
+    if (__this->resume_timer) {
+        sys_timer_del(__this->resume_timer);
+        __this->resume_timer = 0;
+    }
 #endif
     local_music_switch_local_device(NULL);
     server_close(__this->dec_server);
     __this->dec_server = NULL;
+    if (__this->local_bp.data) {
+        free(__this->local_bp.data);
+        __this->local_bp.data = NULL;
+    }
+#ifdef LOCAL_MUSIC_GAPLESS_ENABLE
+    if (__this->next_server) {
+        server_close(__this->next_server);
+        __this->next_server = NULL;
+    }
+#endif
 }
 
 static int local_music_key_click(struct key_event *key)
@@ -622,6 +1672,12 @@ static int local_music_key_long(struct key_event *key)
     case KEY_VOLUME_INC:
         local_music_dec_switch_file(FSEL_NEXT_FILE);
         break;
+    case KEY_UP:
+        local_music_dec_seek(-LOCAL_MUSIC_SEEK_STEP);
+        break;
+    case KEY_DOWN:
+        local_music_dec_seek(LOCAL_MUSIC_SEEK_STEP);
+        break;
     case KEY_MODE:
 #if defined CONFIG_REVERB_MODE_ENABLE && defined CONFIG_AUDIO_MIX_ENABLE
         if (__this->reverb_enable) {
@@ -658,6 +1714,15 @@ static int local_music_key_event_handler(struct key_event *key)
         return local_music_key_click(key);
     case KEY_EVENT_LONG:
         return local_music_key_long(key);
+#ifdef LOCAL_MUSIC_SHUFFLE_ENABLE
+    case KEY_EVENT_DOUBLE_CLICK:
+        //双击OK键切换随机播放
+        if (key->value == KEY_OK) {
+            local_music_shuffle_toggle();
+            return true;
+        }
+        return false;
+#endif
     default:
         break;
     }
@@ -6,6 +6,7 @@
 #include "event/key_event.h"
 #include "fs/fs.h"
 #include "action.h"
+#include "music_mix.h"
 struct audio_app_t {
     const char *tone_file_name;
     const char *app_name;
@@ -41,6 +42,9 @@ static void dec_server_event_handler(void *priv, int argc, int *argv)
         server_request(priv, AUDIO_REQ_DEC, &r);
         server_close(priv); //priv是server_register_event_handler_to_task的priv参数
         fclose((FILE *)argv[1]); //argv[1]是解码开始时传递进去的文件句柄
+#ifdef MUSIC_MIX_ENABLE
+        music_mix_duck(0);
+#endif
         key_event_enable();
         //等提示音播完了再切换模式
         struct intent it;
@@ -95,6 +99,10 @@ int app_play_tone_file(const char *path)
         goto __err;
     }
 
+#ifdef MUSIC_MIX_ENABLE
+    //提示音和音乐在DAC里叠加，播提示音期间把音乐压低；启动成功才压，结束/出错事件里放开
+    music_mix_duck(1);
+#endif
     key_event_disable();
 
     return 0;
@@ -0,0 +1,327 @@
+/*
+@file: music_cache.c
+@brief: 本地播放预读缓存
+        解码器按帧零碎地fread，这里换成按块对齐的整块读卡：两块缓冲，解码器读进一块时
+        后台任务预读下一块，解码器只做内存拷贝；跳转到缓存外时丢掉还没开始的旧预读，
+        先读新位置所在的块；卡忙(录音写卡)时也有一整块的余量，解码不会卡住；
+        下层可以接解密vfs，缓存里放的是解密后的数据；
+        可以跳过文件中间一段，解码器读完文件头直接读到跳转的目标帧
+@date: 2026/10/19
+*/
+
+#include "os/os_api.h"
+#include "app_config.h"
+#include "fs/fs.h"
+#include "music_cache.h"
+
+#ifdef MUSIC_CACHE_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[MUSIC_CACHE]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+#define BLOCK_ALIGN(x)  ((x) & ~(MUSIC_CACHE_BLOCK_SIZE - 1))
+
+enum {
+    BLOCK_EMPTY = 0,
+    BLOCK_FILLING,
+    BLOCK_READY,
+};
+
+static struct music_cache *cache_list;
+
+static int music_cache_lower_read_at(struct music_cache *c, u32 offset, u8 *buf, u32 len)
+{
+    if (c->lower) {
+        c->lower->fseek(c->file, offset, SEEK_SET);
+        return c->lower->fread(c->file, buf, len);
+    }
+    fseek(c->file, offset, SEEK_SET);
+    return fread(buf, len, 1, c->file);
+}
+
+//offset是解码器看到的偏移，跨过跳过的一段时分两次读
+static int music_cache_lower_read(struct music_cache *c, u32 offset, u8 *buf, u32 len)
+{
+    int n, m;
+
+    if (offset < c->skip_from && offset + len > c->skip_from) {
+        n = music_cache_lower_read_at(c, offset, buf, c->skip_from - offset);
+        if (n != c->skip_from - offset) {
+            return n;
+        }
+        m = music_cache_lower_read_at(c, c->skip_to, buf + n, len - n);
+        return m > 0 ? n + m : n;
+    }
+    if (offset >= c->skip_from) {
+        offset += c->skip_to - c->skip_from;
+    }
+    return music_cache_lower_read_at(c, offset, buf, len);
+}
+
+//offset处的块，在读或已读好都算
+static struct music_cache_block *music_cache_find(struct music_cache *c, u32 offset)
+{
+    for (int i = 0; i < MUSIC_CACHE_BLOCKS; i++) {
+        if (c->block[i].state != BLOCK_EMPTY && c->block[i].offset == offset) {
+            return &c->block[i];
+        }
+    }
+    return NULL;
+}
+
+//挑一块来装新数据，解码器正在读的那块不动
+static struct music_cache_block *music_cache_victim(struct music_cache *c)
+{
+    struct music_cache_block *v = NULL;
+    u32 cur = BLOCK_ALIGN(c->pos);
+
+    for (int i = 0; i < MUSIC_CACHE_BLOCKS; i++) {
+        struct music_cache_block *b = &c->block[i];
+        if (b->state == BLOCK_FILLING || (b->state == BLOCK_READY && b->offset == cur)) {
+            continue;
+        }
+        if (!v || b->state == BLOCK_EMPTY) {
+            v = b;
+        }
+    }
+    return v;
+}
+
+//持锁调用，新请求顶掉还没开始的旧请求
+static void music_cache_request(struct music_cache *c, u32 offset)
+{
+    if (offset >= c->file_len || music_cache_find(c, offset)) {
+        return;
+    }
+    c->req = offset;
+    os_sem_post(&c->sem);
+}
+
+static void music_cache_task(void *priv)
+{
+    struct music_cache *c = (struct music_cache *)priv;
+    struct music_cache_block *b;
+    int offset, len;
+
+    while (1) {
+        os_sem_pend(&c->sem, 0);
+        if (c->exit) {
+            break;
+        }
+
+        os_mutex_pend(&c->mutex, 0);
+        offset = c->req;
+        c->req = -1;
+        b = NULL;
+        if (offset >= 0 && !music_cache_find(c, offset)) {
+            b = music_cache_victim(c);
+        }
+        if (b) {
+            b->state = BLOCK_FILLING;
+            b->offset = offset;
+            b->len = 0;
+        }
+        os_mutex_post(&c->mutex);
+        if (!b) {
+            continue;
+        }
+
+        len = MIN(MUSIC_CACHE_BLOCK_SIZE, c->file_len - offset);
+        len = music_cache_lower_read(c, offset, b->data, len);
+
+        os_mutex_pend(&c->mutex, 0);
+        b->len = len > 0 ? len : 0;
+        b->state = BLOCK_READY;
+        c->blocks_read++;
+        if (c->waiting) {
+            c->waiting = 0;
+            os_sem_post(&c->wait_sem);
+        }
+        os_mutex_post(&c->mutex);
+    }
+}
+
+static int music_cache_vfs_fread(void *priv, void *data, u32 len)
+{
+    struct music_cache *c = (struct music_cache *)priv;
+    struct music_cache_block *b;
+    u8 *p = (u8 *)data;
+    u32 done = 0;
+    u32 n;
+    u8 waited = 0;
+
+    os_mutex_pend(&c->mutex, 0);
+    if (c->pos >= c->file_len) {
+        len = 0;
+    } else if (len > c->file_len - c->pos) {
+        len = c->file_len - c->pos;
+    }
+
+    while (done < len) {
+        b = music_cache_find(c, BLOCK_ALIGN(c->pos));
+        if (!b || b->state != BLOCK_READY) {
+            //不在缓存或正在读，等后台读完这块
+            if (!b) {
+                music_cache_request(c, BLOCK_ALIGN(c->pos));
+            }
+            c->waiting = 1;
+            waited = 1;
+            os_mutex_post(&c->mutex);
+            os_sem_pend(&c->wait_sem, 0);
+            os_mutex_pend(&c->mutex, 0);
+            continue;
+        }
+        if (c->pos >= b->offset + b->len) {
+            break;      //读卡出错，块没读满
+        }
+
+        //这块在读位置上，预读任务不会选它，拷贝时不用持锁
+        n = MIN(len - done, b->offset + b->len - c->pos);
+        os_mutex_post(&c->mutex);
+        memcpy(p + done, b->data + (c->pos - b->offset), n);
+        os_mutex_pend(&c->mutex, 0);
+        done += n;
+        c->pos += n;
+
+        //一进这块就预读下一块
+        music_cache_request(c, b->offset + MUSIC_CACHE_BLOCK_SIZE);
+    }
+    if (waited) {
+        c->misses++;
+    } else {
+        c->hits++;
+    }
+    os_mutex_post(&c->mutex);
+
+    return done;
+}
+
+static int music_cache_vfs_fseek(void *priv, u32 offset, int orig)
+{
+    struct music_cache *c = (struct music_cache *)priv;
+
+    os_mutex_pend(&c->mutex, 0);
+    if (orig == SEEK_CUR) {
+        c->pos += (int)offset;
+    } else if (orig == SEEK_END) {
+        c->pos = c->file_len + (int)offset;
+    } else {
+        c->pos = offset;
+    }
+    //跳到缓存外，旧位置的预读作废，先读新位置
+    if (!music_cache_find(c, BLOCK_ALIGN(c->pos))) {
+        c->req = -1;
+        music_cache_request(c, BLOCK_ALIGN(c->pos));
+    }
+    os_mutex_post(&c->mutex);
+
+    return 0;
+}
+
+static int music_cache_vfs_flen(void *priv)
+{
+    struct music_cache *c = (struct music_cache *)priv;
+
+    return c->file_len;
+}
+
+const struct audio_vfs_ops music_cache_vfs_ops = {
+    .fread  = music_cache_vfs_fread,
+    .fseek  = music_cache_vfs_fseek,
+    .flen   = music_cache_vfs_flen,
+};
+
+//包一层缓存，返回值当作文件句柄配合music_cache_vfs_ops交给解码器；失败时file仍归调用者
+//skip_from和skip_to相等时不跳过
+struct music_cache *music_cache_open(FILE *file, const struct audio_vfs_ops *lower, u32 skip_from, u32 skip_to)
+{
+    struct music_cache *c = zalloc(sizeof(*c));
+
+    if (!c) {
+        return NULL;
+    }
+    c->file = file;
+    c->lower = lower;
+    c->req = -1;
+    c->file_len = (lower && lower->flen) ? lower->flen(file) : flen(file);
+    if (skip_from < skip_to && skip_to <= c->file_len) {
+        c->skip_from = skip_from;
+        c->skip_to = skip_to;
+        c->file_len -= skip_to - skip_from;
+    }
+
+    for (int i = 0; i < MUSIC_CACHE_BLOCKS; i++) {
+        c->block[i].data = malloc(MUSIC_CACHE_BLOCK_SIZE);
+        if (!c->block[i].data) {
+            goto __err;
+        }
+    }
+
+    os_mutex_create(&c->mutex);
+    os_sem_create(&c->sem, 0);
+    os_sem_create(&c->wait_sem, 0);
+    if (thread_fork("music_cache", MUSIC_CACHE_TASK_PRIO, MUSIC_CACHE_TASK_STK, 0,
+                    &c->pid, music_cache_task, c)) {
+        os_sem_del(&c->sem, OS_DEL_ALWAYS);
+        os_sem_del(&c->wait_sem, OS_DEL_ALWAYS);
+        os_mutex_del(&c->mutex, OS_DEL_ALWAYS);
+        goto __err;
+    }
+
+    //解码器打开时先读文件头，第一块马上开始读
+    os_mutex_pend(&c->mutex, 0);
+    music_cache_request(c, 0);
+    os_mutex_post(&c->mutex);
+
+    c->next = cache_list;
+    cache_list = c;
+
+    return c;
+
+__err:
+    for (int i = 0; i < MUSIC_CACHE_BLOCKS; i++) {
+        if (c->block[i].data) {
+            free(c->block[i].data);
+        }
+    }
+    free(c);
+    return NULL;
+}
+
+//关闭交给解码器的句柄，是缓存的连同底下的文件一起关，否则当普通文件关
+int music_cache_fclose(FILE *file)
+{
+    struct music_cache **pp = &cache_list;
+    struct music_cache *c;
+    int err;
+
+    while (*pp && (FILE *)*pp != file) {
+        pp = &(*pp)->next;
+    }
+    if (!*pp) {
+        return fclose(file);
+    }
+    c = *pp;
+    *pp = c->next;
+
+    c->exit = 1;
+    os_sem_post(&c->sem);
+    thread_kill(&c->pid, KILL_WAIT);
+    log_info("close: hit %d miss %d, %d blocks", c->hits, c->misses, c->blocks_read);
+
+    os_sem_del(&c->sem, OS_DEL_ALWAYS);
+    os_sem_del(&c->wait_sem, OS_DEL_ALWAYS);
+    os_mutex_del(&c->mutex, OS_DEL_ALWAYS);
+    for (int i = 0; i < MUSIC_CACHE_BLOCKS; i++) {
+        free(c->block[i].data);
+    }
+    err = fclose(c->file);
+    free(c);
+
+    return err;
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+@file: music_cache.h
+@brief: 本地播放预读缓存，作为解码器的vfs_ops
+@date: 2026/10/19
+*/
+#ifndef _MUSIC_CACHE_H_
+#define _MUSIC_CACHE_H_
+
+#include "os/os_api.h"
+#include "app_config.h"
+#include "fs/fs.h"
+#include "server/audio_server.h"
+
+#define MUSIC_CACHE_ENABLE      // 预读缓存开关
+
+#ifdef MUSIC_CACHE_ENABLE
+
+#define MUSIC_CACHE_BLOCK_SIZE  (16 * 1024) // 每块大小，按块对齐的文件偏移整块读卡
+#define MUSIC_CACHE_BLOCKS      2           // 双缓冲：解码器读一块，后台预读下一块
+#define MUSIC_CACHE_TASK_PRIO   5           // 预读任务优先级，低于解码
+#define MUSIC_CACHE_TASK_STK    1024
+
+struct music_cache_block {
+    u8 *data;
+    u32 offset;                     // 块在文件里的起始偏移，按块大小对齐
+    u32 len;                        // 有效长度，文件末尾的块不满
+    u8 state;
+};
+
+struct music_cache {
+    struct music_cache *next;       // 已打开的缓存链表，music_cache_fclose用来区分普通文件
+    FILE *file;
+    const struct audio_vfs_ops *lower;  // 下层vfs(如解密)，为NULL时直接读文件
+    u32 skip_from;                  // 文件里[skip_from, skip_to)这段对解码器不可见，跳转时用
+    u32 skip_to;
+    u32 file_len;                   // 解码器看到的长度，已去掉跳过的一段
+    u32 pos;                        // 解码器的读位置
+    int req;                        // 待读的块偏移，-1没有
+    u8 waiting;                     // 解码器在等块
+    u8 exit;
+    OS_MUTEX mutex;
+    OS_SEM sem;                     // 通知预读任务
+    OS_SEM wait_sem;                // 通知等块的解码器
+    int pid;
+    u32 hits;                       // 不用等就读到的次数
+    u32 misses;                     // 要等读卡的次数
+    u32 blocks_read;
+    struct music_cache_block block[MUSIC_CACHE_BLOCKS];
+};
+
+extern const struct audio_vfs_ops music_cache_vfs_ops;
+
+struct music_cache *music_cache_open(FILE *file, const struct audio_vfs_ops *lower, u32 skip_from, u32 skip_to);
+int music_cache_fclose(FILE *file);
+
+#endif
+
+#endif
@@ -0,0 +1,761 @@
+/*
+@file: music_index.c
+@brief: 本地音乐媒体库索引
+        插卡时把卷上所有音乐文件的路径、文件夹、格式、大小、修改时间写进卷根目录的定长索引文件，
+        上下曲/切文件夹直接按序号读一条记录打开，不再每次fscan整张卡；
+        各文件夹名和里面的音乐文件数和建索引时一致就认为音乐没变，直接用旧索引，录音等其他文件不影响；
+        变了才重建，重建时同一文件(起始簇+大小+修改时间相同)沿用旧记录里播放时回填的时长；
+        重建可以放到后台任务，扫到一条写一条，调用者边扫边能读到已扫到的曲目和文件夹；
+        解码出错/文件头坏的曲目记在条目标志和文件末尾的位图里，重建时跟着文件走；
+        条目指向的文件打不开说明索引过时，只标记下次重建，不当坏文件
+@date: 2026/10/19
+*/
+
+#include <stddef.h>
+#include "os/os_api.h"
+#include "app_config.h"
+#include "fs/fs.h"
+#include "music_index.h"
+#include "music_seek.h"
+#include "file_util.h"
+
+#ifdef MUSIC_INDEX_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[MUSIC_IDX]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+#define ENTRY_SIZE      sizeof(struct music_index_entry)
+#define ENTRY_OFFSET(n) (MUSIC_INDEX_HDR_SIZE + (n) * ENTRY_SIZE)
+#define BAD_OFFSET(n)   ENTRY_OFFSET(n)     // 位图紧跟在n条条目之后
+#define BAD_BYTES(n)    (((n) + 7) / 8)
+
+struct music_index_builder {
+    struct music_index *ix;
+    FILE *fp;
+    FILE *old_fp;                   // 旧索引，沿用已回填的字段
+    int old_count;
+    int old_pos;
+    int root_len;
+    int reused;
+    int err;
+    volatile u8 cancel;             // 拔卡/换卡时中止后台建索引
+    volatile u8 done;
+    OS_SEM sem;
+    int pid;
+    struct music_index_hdr old_hdr; // 放这里不占任务栈
+};
+
+static const struct {
+    char ext[4];
+    u8 format;
+} music_format_table[] = {
+    {"MP3", MUSIC_FMT_MP3},
+    {"WMA", MUSIC_FMT_WMA},
+    {"WAV", MUSIC_FMT_WAV},
+    {"M4A", MUSIC_FMT_M4A},
+    {"AMR", MUSIC_FMT_AMR},
+    {"APE", MUSIC_FMT_APE},
+    {"FLA", MUSIC_FMT_FLAC},
+    {"AAC", MUSIC_FMT_AAC},
+    {"SPX", MUSIC_FMT_SPX},
+    {"OPU", MUSIC_FMT_OPUS},
+    {"DTS", MUSIC_FMT_DTS},
+    {"ADP", MUSIC_FMT_ADPCM},
+    {"SMP", MUSIC_FMT_SMP},
+};
+
+static void music_index_lock(struct music_index *ix)
+{
+    if (ix->mutex_ready) {
+        os_mutex_pend(&ix->mutex, 0);
+    }
+}
+
+static void music_index_unlock(struct music_index *ix)
+{
+    if (ix->mutex_ready) {
+        os_mutex_post(&ix->mutex);
+    }
+}
+
+static void music_index_path(char *buf, int size, const char *root, const char *name)
+{
+    snprintf(buf, size, "%s%s", root, name);
+}
+
+static u32 music_index_hdr_crc(const struct music_index_hdr *hdr)
+{
+    u32 crc = file_crc32(0, hdr, offsetof(struct music_index_hdr, crc));
+    return file_crc32(crc, hdr->dir_first, sizeof(hdr->dir_first));
+}
+
+static int music_index_hdr_valid(const struct music_index_hdr *hdr)
+{
+    return hdr->magic == MUSIC_INDEX_MAGIC && hdr->version == MUSIC_INDEX_VERSION &&
+           hdr->dir_count <= MUSIC_INDEX_DIR_MAX && hdr->track_count <= MUSIC_INDEX_TRACK_MAX &&
+           hdr->crc == music_index_hdr_crc(hdr);
+}
+
+static void music_index_entry_seal(struct music_index_entry *e)
+{
+    e->crc = file_crc32(0, e, offsetof(struct music_index_entry, crc));
+}
+
+//按扩展名取格式，长文件名是UTF-16，字符之间夹着0，取点后面前三个非0字节
+static u8 music_index_format(const char *name, int len)
+{
+    char ext[4] = {0};
+    int dot = len - 1;
+    int n = 0;
+
+    while (dot >= 0 && name[dot] != '.') {
+        dot--;
+    }
+    if (dot < 0) {
+        return MUSIC_FMT_UNKNOWN;
+    }
+    for (int i = dot + 1; i < len && n < 3; i++) {
+        char c = name[i];
+        if (c) {
+            ext[n++] = (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+        }
+    }
+    for (int i = 0; i < ARRAY_SIZE(music_format_table); i++) {
+        if (!memcmp(ext, music_format_table[i].ext, 3)) {
+            return music_format_table[i].format;
+        }
+    }
+    return MUSIC_FMT_UNKNOWN;
+}
+
+static u32 music_index_mtime(const struct sys_time *t)
+{
+    return ((u32)(t->year - 1980) << 25) | ((u32)t->month << 21) | ((u32)t->day << 16) |
+           ((u32)t->hour << 11) | ((u32)t->min << 5) | (t->sec >> 1);
+}
+
+//旧索引和新扫描的顺序基本一致，从上次匹配的位置往后找一小段
+static void music_index_reuse(struct music_index_builder *b, struct music_index_entry *e)
+{
+    struct music_index_entry old;
+
+    for (int k = b->old_pos; k < b->old_count && k < b->old_pos + MUSIC_INDEX_REUSE_WIN; k++) {
+        fseek(b->old_fp, ENTRY_OFFSET(k), SEEK_SET);
+        if (fread(&old, ENTRY_SIZE, 1, b->old_fp) != ENTRY_SIZE) {
+            break;
+        }
+        if (old.sclust == e->sclust && old.size == e->size && old.mtime == e->mtime) {
+            e->duration_ms = old.duration_ms;
+            e->flags = old.flags;
+            e->gain = old.gain;
+            b->old_pos = k + 1;
+            b->reused++;
+            return;
+        }
+    }
+}
+
+//收录一个文件夹下的音乐文件(不递归)
+static void music_index_scan_dir(struct music_index_builder *b, const char *dir_path, int dir)
+{
+    struct music_index_entry e;
+    struct vfs_attr attr;
+    struct vfscan *fs;
+    FILE *fp;
+    char path[MUSIC_INDEX_PATH_MAX + 32];
+    char name[64];
+    int len;
+
+    fs = fscan(dir_path, MUSIC_INDEX_SCAN_ARG, 1);
+    if (!fs) {
+        return;
+    }
+    for (int i = 1; i <= fs->file_number && !b->err && !b->cancel; i++) {
+        if (b->ix->hdr.track_count >= MUSIC_INDEX_TRACK_MAX) {
+            break;
+        }
+        fp = fselect(fs, FSEL_BY_NUMBER, i);
+        if (!fp) {
+            continue;
+        }
+        memset(name, 0, sizeof(name));
+        memset(&attr, 0, sizeof(attr));
+        len = fget_name(fp, (u8 *)name, sizeof(name) - 2);
+        fget_attrs(fp, &attr);
+        fclose(fp);
+        if (len <= 0) {
+            continue;
+        }
+
+        memset(path, 0, sizeof(path));
+        fname_to_path(path, dir_path, name, len, 0, 0);
+        memset(&e, 0, sizeof(e));
+        e.path_len = file_path_len(path) - b->root_len;
+        if (e.path_len == 0 || e.path_len > MUSIC_INDEX_PATH_MAX - 2) {
+            log_w("music index path too long\n");
+            continue;
+        }
+        memcpy(e.path, path + b->root_len, e.path_len);
+        e.sclust = attr.sclust;
+        e.size = attr.fsize;
+        e.mtime = music_index_mtime(&attr.wrt_time);
+        e.dir = dir;
+        e.format = music_index_format(name, len);
+        if (b->old_fp) {
+            music_index_reuse(b, &e);
+        }
+        music_index_entry_seal(&e);
+
+        //条目写完再加数，读的一方只会看到完整的条目
+        music_index_lock(b->ix);
+        fseek(b->fp, ENTRY_OFFSET(b->ix->hdr.track_count), SEEK_SET);
+        if (fwrite(&e, ENTRY_SIZE, 1, b->fp) != ENTRY_SIZE) {
+            b->err = -1;
+        } else {
+            if (e.flags & MUSIC_INDEX_FLAG_BAD) {
+                b->ix->bad[b->ix->hdr.track_count / 8] |= BIT(b->ix->hdr.track_count % 8);
+            }
+            b->ix->hdr.track_count++;
+        }
+        music_index_unlock(b->ix);
+    }
+    fscan_release(fs);
+}
+
+static void music_index_reset(struct music_index *ix, const char *root)
+{
+    music_index_close(ix);
+    ix->root = root;
+    os_mutex_create(&ix->mutex);
+    ix->mutex_ready = 1;
+}
+
+//等后台任务退出，放弃时任务自己删掉临时文件
+static void music_index_build_join(struct music_index *ix, u8 cancel)
+{
+    struct music_index_builder *b = ix->builder;
+
+    b->cancel = cancel;
+    os_sem_post(&b->sem);
+    thread_kill(&b->pid, KILL_WAIT);
+    os_sem_del(&b->sem, OS_DEL_ALWAYS);
+    ix->builder = NULL;
+    free(b);
+}
+
+//音乐目录的指纹：按建索引的顺序走根目录和各文件夹，累计文件夹名和里面音乐文件数的CRC
+//只列目录不读文件属性，比重建快得多；录音(JRC)和索引自己这些非音乐文件不计入
+static u32 music_index_fingerprint(const char *root)
+{
+    struct vfscan *dir_list;
+    struct vfscan *fs;
+    FILE *dir;
+    char dir_path[MUSIC_INDEX_PATH_MAX];
+    char name[64];
+    u32 crc = 0;
+    u32 n;
+    int len;
+
+    fs = fscan(root, MUSIC_INDEX_COUNT_ARG, 1);
+    n = fs ? fs->file_number : 0;
+    if (fs) {
+        fscan_release(fs);
+    }
+    crc = file_crc32(crc, &n, sizeof(n));
+
+    dir_list = fscan(root, "-d -sn", 2);
+    if (!dir_list) {
+        return crc;
+    }
+    for (int i = 1; i <= dir_list->file_number && i < MUSIC_INDEX_DIR_MAX; i++) {
+        dir = fselect(dir_list, FSEL_BY_NUMBER, i);
+        if (!dir) {
+            continue;
+        }
+        memset(name, 0, sizeof(name));
+        len = fget_name(dir, (u8 *)name, sizeof(name) - 2);
+        fclose(dir);
+        if (len <= 0) {
+            continue;
+        }
+        memset(dir_path, 0, sizeof(dir_path));
+        fname_to_path(dir_path, root, name, len, 1, 0);
+        fs = fscan(dir_path, MUSIC_INDEX_COUNT_ARG, 1);
+        n = fs ? fs->file_number : 0;
+        if (fs) {
+            fscan_release(fs);
+        }
+        crc = file_crc32(crc, name, len);
+        crc = file_crc32(crc, &n, sizeof(n));
+    }
+    fscan_release(dir_list);
+
+    return crc;
+}
+
+//打开已有索引，音乐目录的指纹和建索引时不同说明音乐变了，返回-1由调用者重建
+int music_index_open(struct music_index *ix, const char *root)
+{
+    char path[64];
+    u32 fingerprint;
+
+    music_index_reset(ix, root);
+
+    music_index_path(path, sizeof(path), root, MUSIC_INDEX_FILE);
+    ix->fp = fopen(path, "r+");
+    if (!ix->fp) {
+        return -1;
+    }
+    if (fread(&ix->hdr, sizeof(ix->hdr), 1, ix->fp) != sizeof(ix->hdr) ||
+        !music_index_hdr_valid(&ix->hdr)) {
+        goto __err;
+    }
+    if (ix->hdr.stale) {
+        log_info("stale");
+        goto __err;
+    }
+    fingerprint = music_index_fingerprint(root);
+    if (fingerprint != ix->hdr.fingerprint) {
+        log_info("music changed: %x -> %x", ix->hdr.fingerprint, fingerprint);
+        goto __err;
+    }
+    fseek(ix->fp, BAD_OFFSET(ix->hdr.track_count), SEEK_SET);
+    if (fread(ix->bad, BAD_BYTES(ix->hdr.track_count), 1, ix->fp) != BAD_BYTES(ix->hdr.track_count)) {
+        goto __err;
+    }
+    log_info("open: %d tracks %d dirs", ix->hdr.track_count, ix->hdr.dir_count);
+
+    return 0;
+
+__err:
+    fclose(ix->fp);
+    ix->fp = NULL;
+    memset(&ix->hdr, 0, sizeof(ix->hdr));
+    return -1;
+}
+
+//扫描整个卷重建索引：根目录是文件夹0，其余按fscan的文件夹顺序
+//扫到的曲目和文件夹即时计入ix->hdr，调用者边扫边能用
+static int music_index_build_run(struct music_index_builder *b, const char *root)
+{
+    struct music_index *ix = b->ix;
+    struct music_index_hdr *old_hdr = &b->old_hdr;
+    struct vfscan *dir_list;
+    FILE *dir;
+    char path[64];
+    char dir_path[MUSIC_INDEX_PATH_MAX];
+    char name[64];
+    u32 t = timer_get_ms();
+    int len, n;
+
+    b->root_len = strlen(root);
+
+    music_index_path(path, sizeof(path), root, MUSIC_INDEX_FILE);
+    b->old_fp = fopen(path, "r");
+    if (b->old_fp) {
+        if (fread(old_hdr, sizeof(*old_hdr), 1, b->old_fp) == sizeof(*old_hdr) && music_index_hdr_valid(old_hdr)) {
+            b->old_count = old_hdr->track_count;
+        } else {
+            fclose(b->old_fp);
+            b->old_fp = NULL;
+        }
+    }
+
+    music_index_path(path, sizeof(path), root, MUSIC_INDEX_TMP);
+    b->fp = fopen(path, "w+");
+    if (!b->fp) {
+        goto __err;
+    }
+    //先占住文件头，条目写完再填
+    memset(old_hdr, 0, sizeof(*old_hdr));
+    if (fwrite(old_hdr, sizeof(*old_hdr), 1, b->fp) != sizeof(*old_hdr)) {
+        goto __err;
+    }
+
+    music_index_lock(ix);
+    ix->fp = b->fp;
+    ix->hdr.dir_first[0] = 0;
+    ix->hdr.dir_count = 1;
+    music_index_unlock(ix);
+    music_index_scan_dir(b, root, 0);
+
+    dir_list = fscan(root, "-d -sn", 2);
+    if (dir_list) {
+        for (int i = 1; i <= dir_list->file_number && !b->err && !b->cancel; i++) {
+            if (ix->hdr.dir_count >= MUSIC_INDEX_DIR_MAX) {
+                log_w("music index too many dirs\n");
+                break;
+            }
+            dir = fselect(dir_list, FSEL_BY_NUMBER, i);
+            if (!dir) {
+                continue;
+            }
+            memset(name, 0, sizeof(name));
+            len = fget_name(dir, (u8 *)name, sizeof(name) - 2);
+            fclose(dir);
+            if (len <= 0) {
+                continue;
+            }
+            memset(dir_path, 0, sizeof(dir_path));
+            fname_to_path(dir_path, root, name, len, 1, 0);
+            //文件夹先登记，里面的曲目扫一首加一首
+            music_index_lock(ix);
+            n = ix->hdr.dir_count;
+            ix->hdr.dir_first[n] = ix->hdr.track_count;
+            ix->hdr.dir_count++;
+            music_index_unlock(ix);
+            music_index_scan_dir(b, dir_path, n);
+        }
+        fscan_release(dir_list);
+    }
+    if (b->err || b->cancel) {
+        goto __err;
+    }
+
+    //坏文件位图写在条目后面
+    music_index_lock(ix);
+    fseek(b->fp, BAD_OFFSET(ix->hdr.track_count), SEEK_SET);
+    n = BAD_BYTES(ix->hdr.track_count);
+    len = n ? fwrite(ix->bad, n, 1, b->fp) : 0;
+    music_index_unlock(ix);
+    if (len != n) {
+        goto __err;
+    }
+
+    //旧索引删掉再改名
+    if (b->old_fp) {
+        fdelete(b->old_fp);
+        b->old_fp = NULL;
+    }
+    music_index_path(path, sizeof(path), root, MUSIC_INDEX_FILE);
+    music_index_lock(ix);
+    len = frename(b->fp, path);
+    music_index_unlock(ix);
+    if (len) {
+        goto __err;
+    }
+#ifdef MUSIC_SEEK_ENABLE
+    //跳转表按曲目数占好空间，之后后台原地填表
+    if (music_seek_prealloc(ix)) {
+        log_w("music seek table alloc err\n");
+    }
+#endif
+    //指纹在扫描之外单独算，和打开时的算法一字不差
+    n = music_index_fingerprint(root);
+
+    music_index_lock(ix);
+    ix->hdr.fingerprint = n;
+    ix->hdr.magic = MUSIC_INDEX_MAGIC;
+    ix->hdr.version = MUSIC_INDEX_VERSION;
+    ix->hdr.crc = music_index_hdr_crc(&ix->hdr);
+    fseek(b->fp, 0, SEEK_SET);
+    len = fwrite(&ix->hdr, sizeof(ix->hdr), 1, b->fp);
+    fflush(b->fp);
+    music_index_unlock(ix);
+    if (len != sizeof(ix->hdr)) {
+        goto __err;
+    }
+
+    log_i("music index build: %d tracks %d dirs, reuse %d, %dms\n",
+          ix->hdr.track_count, ix->hdr.dir_count, b->reused, timer_get_ms() - t);
+
+    return 0;
+
+__err:
+    log_e("music index build err\n");
+    if (b->old_fp) {
+        fclose(b->old_fp);
+        b->old_fp = NULL;
+    }
+    music_index_lock(ix);
+    if (b->fp) {
+        fdelete(b->fp);
+        b->fp = NULL;
+    }
+    ix->fp = NULL;
+    memset(&ix->hdr, 0, sizeof(ix->hdr));
+    music_index_unlock(ix);
+    return -1;
+}
+
+int music_index_build(struct music_index *ix, const char *root)
+{
+    struct music_index_builder b = {0};
+
+    music_index_reset(ix, root);
+    b.ix = ix;
+
+    return music_index_build_run(&b, root);
+}
+
+static void music_index_build_task(void *priv)
+{
+    struct music_index_builder *b = (struct music_index_builder *)priv;
+
+    music_index_build_run(b, b->ix->root);
+    b->done = 1;
+
+    //建完等music_index_building/music_index_close收尾
+    os_sem_pend(&b->sem, 0);
+}
+
+//后台建索引，不阻塞调用者；建完前ix->fp是临时文件，已扫到的曲目可以照常读和播放
+int music_index_build_start(struct music_index *ix, const char *root)
+{
+    struct music_index_builder *b;
+
+    music_index_reset(ix, root);
+    b = zalloc(sizeof(*b));
+    if (!b) {
+        return -1;
+    }
+    b->ix = ix;
+    os_sem_create(&b->sem, 0);
+    ix->builder = b;
+    if (thread_fork("music_index", MUSIC_INDEX_TASK_PRIO, MUSIC_INDEX_TASK_STK, 0,
+                    &b->pid, music_index_build_task, b)) {
+        ix->builder = NULL;
+        os_sem_del(&b->sem, OS_DEL_ALWAYS);
+        free(b);
+        return -1;
+    }
+    return 0;
+}
+
+//后台还在建返回1；建完回收任务，成功时ix->fp已是正式索引，失败时为空
+int music_index_building(struct music_index *ix)
+{
+    if (!ix->builder) {
+        return 0;
+    }
+    if (!ix->builder->done) {
+        return 1;
+    }
+    music_index_build_join(ix, 0);
+    return 0;
+}
+
+//后台在建时先中止，拔卡时不等扫完
+void music_index_close(struct music_index *ix)
+{
+    if (ix->builder) {
+        music_index_build_join(ix, 1);
+    }
+    if (ix->fp) {
+        fclose(ix->fp);
+        ix->fp = NULL;
+    }
+    if (ix->mutex_ready) {
+        os_mutex_del(&ix->mutex, OS_DEL_ALWAYS);
+        ix->mutex_ready = 0;
+    }
+    memset(&ix->hdr, 0, sizeof(ix->hdr));
+    memset(ix->bad, 0, sizeof(ix->bad));
+}
+
+int music_index_read(struct music_index *ix, int track, struct music_index_entry *e)
+{
+    int err = -1;
+
+    music_index_lock(ix);
+    if (ix->fp && track >= 0 && track < ix->hdr.track_count) {
+        fseek(ix->fp, ENTRY_OFFSET(track), SEEK_SET);
+        if (fread(e, ENTRY_SIZE, 1, ix->fp) == ENTRY_SIZE &&
+            e->crc == file_crc32(0, e, offsetof(struct music_index_entry, crc))) {
+            err = 0;
+        }
+    }
+    music_index_unlock(ix);
+
+    return err;
+}
+
+FILE *music_index_fopen(struct music_index *ix, int track)
+{
+    struct music_index_entry e;
+    char path[MUSIC_INDEX_PATH_MAX + 32];
+    int root_len = strlen(ix->root);
+
+    if (music_index_read(ix, track, &e) || root_len + e.path_len + 2 > sizeof(path)) {
+        return NULL;
+    }
+    memset(path, 0, sizeof(path));
+    memcpy(path, ix->root, root_len);
+    memcpy(path + root_len, e.path, e.path_len);
+
+    return fopen(path, "r");
+}
+
+//文件夹里曲目的序号范围
+int music_index_dir_range(struct music_index *ix, int dir, int *first, int *count)
+{
+    int end;
+    int err = -1;
+
+    music_index_lock(ix);
+    if (dir >= 0 && dir < ix->hdr.dir_count) {
+        end = dir + 1 < ix->hdr.dir_count ? ix->hdr.dir_first[dir + 1] : ix->hdr.track_count;
+        *first = ix->hdr.dir_first[dir];
+        *count = end - *first;
+        err = 0;
+    }
+    music_index_unlock(ix);
+
+    return err;
+}
+
+//曲目所在的文件夹，按文件夹表二分
+int music_index_dir_of(struct music_index *ix, int track)
+{
+    int lo = 0, hi;
+
+    music_index_lock(ix);
+    hi = ix->hdr.dir_count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (ix->hdr.dir_first[mid] <= track) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    music_index_unlock(ix);
+
+    return lo;
+}
+
+//按起始簇和大小找曲目序号，先试hint(索引没重建过时就是它)，不对再顺序找
+int music_index_find(struct music_index *ix, u32 sclust, u32 size, int hint)
+{
+    struct music_index_entry e;
+
+    if (!music_index_read(ix, hint, &e) && e.sclust == sclust && e.size == size) {
+        return hint;
+    }
+    for (int i = 0; i < ix->hdr.track_count; i++) {
+        if (!music_index_read(ix, i, &e) && e.sclust == sclust && e.size == size) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//首次播放拿到总时长后回填，原地改写
+int music_index_set_duration(struct music_index *ix, int track, u32 duration_ms)
+{
+    struct music_index_entry e;
+    int err = -1;
+
+    if (music_index_read(ix, track, &e)) {
+        return -1;
+    }
+    if (e.duration_ms == duration_ms) {
+        return 0;
+    }
+    e.duration_ms = duration_ms;
+    music_index_entry_seal(&e);
+    music_index_lock(ix);
+    if (ix->fp) {
+        fseek(ix->fp, ENTRY_OFFSET(track), SEEK_SET);
+        if (fwrite(&e, ENTRY_SIZE, 1, ix->fp) == ENTRY_SIZE) {
+            err = 0;
+        }
+    }
+    music_index_unlock(ix);
+
+    return err;
+}
+
+//测好响度后回填，和时长一样原地改写
+int music_index_set_gain(struct music_index *ix, int track, s16 gain)
+{
+    struct music_index_entry e;
+    int err = -1;
+
+    if (music_index_read(ix, track, &e)) {
+        return -1;
+    }
+    e.gain = gain;
+    e.flags |= MUSIC_INDEX_FLAG_GAIN | MUSIC_INDEX_FLAG_PEAK;
+    music_index_entry_seal(&e);
+    music_index_lock(ix);
+    if (ix->fp) {
+        fseek(ix->fp, ENTRY_OFFSET(track), SEEK_SET);
+        if (fwrite(&e, ENTRY_SIZE, 1, ix->fp) == ENTRY_SIZE) {
+            err = 0;
+        }
+    }
+    music_index_unlock(ix);
+    log_info("track %d gain %d", track, gain);
+
+    return err;
+}
+
+//切歌前查，只看内存里的位图
+int music_index_is_bad(struct music_index *ix, int track)
+{
+    if (track < 0 || track >= ix->hdr.track_count) {
+        return 0;
+    }
+    return (ix->bad[track / 8] & BIT(track % 8)) ? 1 : 0;
+}
+
+//记下坏文件：位图和条目标志原地改写，下次插卡和重建索引都还在
+int music_index_set_bad(struct music_index *ix, int track)
+{
+    struct music_index_entry e;
+    int err = -1;
+
+    if (music_index_is_bad(ix, track) || music_index_read(ix, track, &e)) {
+        return -1;
+    }
+    e.flags |= MUSIC_INDEX_FLAG_BAD;
+    music_index_entry_seal(&e);
+
+    music_index_lock(ix);
+    ix->bad[track / 8] |= BIT(track % 8);
+    //后台建索引时位图最后一起写
+    if (ix->fp && !ix->builder) {
+        fseek(ix->fp, BAD_OFFSET(ix->hdr.track_count) + track / 8, SEEK_SET);
+        fwrite(&ix->bad[track / 8], 1, 1, ix->fp);
+    }
+    if (ix->fp) {
+        fseek(ix->fp, ENTRY_OFFSET(track), SEEK_SET);
+        if (fwrite(&e, ENTRY_SIZE, 1, ix->fp) == ENTRY_SIZE) {
+            err = 0;
+        }
+    }
+    music_index_unlock(ix);
+    log_info("track %d marked bad", track);
+
+    return err;
+}
+
+//条目指向的文件打不开，说明卡上内容变过而指纹碰巧没变(如同名替换)：只在卡上的文件头里记一下，
+//本次照常用，下次打开时重建，已回填的字段照样沿用
+int music_index_invalidate(struct music_index *ix)
+{
+    struct music_index_hdr hdr;
+    int err = -1;
+
+    music_index_lock(ix);
+    if (ix->fp && !ix->builder && !ix->hdr.stale) {
+        ix->hdr.stale = 1;
+        memcpy(&hdr, &ix->hdr, sizeof(hdr));
+        hdr.crc = music_index_hdr_crc(&hdr);
+        fseek(ix->fp, 0, SEEK_SET);
+        if (fwrite(&hdr, sizeof(hdr), 1, ix->fp) == sizeof(hdr)) {
+            err = 0;
+        }
+        fflush(ix->fp);
+    }
+    music_index_unlock(ix);
+    log_info("index invalidated");
+
+    return err;
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*
+@file: music_index.h
+@brief: 本地音乐媒体库索引
+@date: 2026/10/19
+*/
+#ifndef _MUSIC_INDEX_H_
+#define _MUSIC_INDEX_H_
+
+#include "os/os_api.h"
+#include "app_config.h"
+#include "fs/fs.h"
+
+#define MUSIC_INDEX_ENABLE      // 媒体库索引开关
+
+#ifdef MUSIC_INDEX_ENABLE
+
+#define MUSIC_INDEX_FILE        "MUSIC.IDX"     // 放在卷根目录
+#define MUSIC_INDEX_TMP         "MUSIC.TMP"     // 重建时先写临时文件，写完再改名
+#define MUSIC_INDEX_MAGIC       0x5844494D      // "MIDX"
+#define MUSIC_INDEX_VERSION     3
+#define MUSIC_INDEX_DIR_MAX     250             // 最多收录的文件夹数(含根目录)
+#define MUSIC_INDEX_TRACK_MAX   10000
+#define MUSIC_INDEX_PATH_MAX    228
+#define MUSIC_INDEX_HDR_SIZE    sizeof(struct music_index_hdr)  // 1024字节，条目从这里开始
+#define MUSIC_INDEX_REUSE_WIN   8               // 重建时在旧索引里向后找同一文件的窗口
+#define MUSIC_INDEX_BAD_SIZE    ((MUSIC_INDEX_TRACK_MAX + 7) / 8)
+#define MUSIC_INDEX_TASK_PRIO   4               // 后台建索引任务优先级，低于解码和预读
+#define MUSIC_INDEX_TASK_STK    2048
+
+#if CONFIG_DEC_DECRYPT_ENABLE
+#define MUSIC_INDEX_SCAN_ARG    "-tMP3WMAWAVM4AAMRAPEFLAAACSPXOPUDTSADPSMP -sn"
+#define MUSIC_INDEX_COUNT_ARG   "-tMP3WMAWAVM4AAMRAPEFLAAACSPXOPUDTSADPSMP"   // 只数文件，不排序
+#else
+#define MUSIC_INDEX_SCAN_ARG    "-tMP3WMAWAVM4AAMRAPEFLAAACSPXOPUDTSADP -sn"
+#define MUSIC_INDEX_COUNT_ARG   "-tMP3WMAWAVM4AAMRAPEFLAAACSPXOPUDTSADP"
+#endif
+
+enum {
+    MUSIC_FMT_UNKNOWN = 0,
+    MUSIC_FMT_MP3,
+    MUSIC_FMT_WMA,
+    MUSIC_FMT_WAV,
+    MUSIC_FMT_M4A,
+    MUSIC_FMT_AMR,
+    MUSIC_FMT_APE,
+    MUSIC_FMT_FLAC,
+    MUSIC_FMT_AAC,
+    MUSIC_FMT_SPX,
+    MUSIC_FMT_OPUS,
+    MUSIC_FMT_DTS,
+    MUSIC_FMT_ADPCM,
+    MUSIC_FMT_SMP,
+};
+
+#define MUSIC_INDEX_FLAG_BAD    0x01            // 开播就解码出错或文件头损坏，切歌时直接跳过
+#define MUSIC_INDEX_FLAG_GAIN   0x02            // gain已测好
+#define MUSIC_INDEX_FLAG_PEAK   0x04            // gain按峰值限过，正增益不会削波；没有的按0dB封顶
+
+struct music_index_hdr {
+    u32 magic;
+    u16 version;
+    u16 dir_count;
+    u32 track_count;
+    u32 fingerprint;                // 建索引时各文件夹名和音乐文件数的CRC，插卡时对比判断音乐有没有变过
+    u32 stale;                      // 播放时发现条目对不上卡上的文件，下次打开时重建
+    u32 crc;                        // 以上字段和文件夹表的CRC32
+    u32 dir_first[MUSIC_INDEX_DIR_MAX];     // 每个文件夹第一首的序号，文件夹0是根目录
+};
+
+//定长256字节，按文件夹顺序排列，第n首在MUSIC_INDEX_HDR_SIZE+n*256处
+//条目之后是每首一位的坏文件位图，打开索引时读进内存
+struct music_index_entry {
+    u32 sclust;                     // 起始簇，和大小、修改时间一起识别同一个文件
+    u32 size;
+    u32 mtime;                      // FAT格式的修改时间
+    u32 duration_ms;                // 0表示还没播放过，首次播放时回填
+    u16 dir;
+    u8  format;
+    u8  flags;
+    u16 path_len;
+    s16 gain;                       // 响度归一化增益，0.01dB为单位，首次播放时边放边测后回填
+    char path[MUSIC_INDEX_PATH_MAX];        // 相对卷根目录的路径
+    u32 crc;
+};
+
+struct music_index_builder;
+
+//后台建索引时fp是正在写的临时文件，hdr随扫描增长，已写入的条目可以照常读
+struct music_index {
+    FILE *fp;
+    const char *root;
+    struct music_index_hdr hdr;
+    OS_MUTEX mutex;                 // 后台建索引和读条目互斥
+    u8 mutex_ready;
+    struct music_index_builder *builder;    // 不为空表示后台还在建
+    u8 bad[MUSIC_INDEX_BAD_SIZE];   // 坏文件位图，切歌前查它不用读卡
+};
+
+int music_index_open(struct music_index *ix, const char *root);
+int music_index_build(struct music_index *ix, const char *root);
+int music_index_build_start(struct music_index *ix, const char *root);
+int music_index_building(struct music_index *ix);
+void music_index_close(struct music_index *ix);
+int music_index_read(struct music_index *ix, int track, struct music_index_entry *e);
+FILE *music_index_fopen(struct music_index *ix, int track);
+int music_index_dir_range(struct music_index *ix, int dir, int *first, int *count);
+int music_index_dir_of(struct music_index *ix, int track);
+int music_index_find(struct music_index *ix, u32 sclust, u32 size, int hint);
+int music_index_set_duration(struct music_index *ix, int track, u32 duration_ms);
+int music_index_set_gain(struct music_index *ix, int track, s16 gain);
+int music_index_is_bad(struct music_index *ix, int track);
+int music_index_set_bad(struct music_index *ix, int track);
+int music_index_invalidate(struct music_index *ix);
+
+#endif
+
+#endif
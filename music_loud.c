@@ -0,0 +1,184 @@
+/*
+@file: music_loud.c
+@brief: 音乐响度测量
+        按EBU R128积分响度的简化算法：先抽取到8K左右，K加权用一阶高通加回+4dB做高架、
+        再过一阶40Hz高通近似；400ms一块(不重叠)算块响度，记进0.5 LU一格的直方图，
+        不用存每块的值；最后按-70 LUFS绝对门限和-10 LU相对门限两次平均得到积分响度；
+        同时记下未抽取的样点峰值，正增益限在峰值放大后不超过满幅，混音级不会硬削波
+@date: 2026/10/19
+*/
+
+#include <math.h>
+#include <string.h>
+#include "app_config.h"
+#include "music_loud.h"
+
+#ifdef MUSIC_LOUD_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[MUSIC_LOUD]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+#define LOUD_SHELF_HZ       1500.0f
+#define LOUD_SHELF_GAIN     0.585f          // +4dB高架：输出加上0.585倍的高通分量
+#define LOUD_HP_HZ          40.0f
+#define LOUD_ABS_GATE       (-70.0f)
+#define LOUD_REL_GATE       (-10.0f)
+#define BIN_LUFS(i)         (LOUD_ABS_GATE + 0.5f * (i) + 0.25f)
+
+//一阶高通y[n] = a * (y[n-1] + x[n] - x[n-1])的系数
+static float music_loud_hp_coef(float hz, float rate)
+{
+    return 1.0f / (1.0f + 2.0f * 3.14159265f * hz / rate);
+}
+
+static void music_loud_setup(struct music_loud *m, u32 sample_rate)
+{
+    float rate;
+
+    m->sample_rate = sample_rate;
+    m->decim = sample_rate / MUSIC_LOUD_RATE;
+    if (m->decim < 1) {
+        m->decim = 1;
+    }
+    rate = (float)sample_rate / m->decim;
+    m->block_len = rate * MUSIC_LOUD_BLOCK_MS / 1000;
+    m->shelf_a = music_loud_hp_coef(LOUD_SHELF_HZ, rate);
+    m->hp_a = music_loud_hp_coef(LOUD_HP_HZ, rate);
+    m->phase = 0;
+    m->block_n = 0;
+    m->acc = 0;
+    memset(m->shelf_x, 0, sizeof(m->shelf_x));
+    memset(m->shelf_y, 0, sizeof(m->shelf_y));
+    memset(m->hp_x, 0, sizeof(m->hp_x));
+    memset(m->hp_y, 0, sizeof(m->hp_y));
+    log_info("rate %d decim %d block %d", sample_rate, m->decim, m->block_len);
+}
+
+//一块收满：块响度过了绝对门限就记进直方图
+static void music_loud_block(struct music_loud *m)
+{
+    float ms = m->acc / m->block_n;
+    float l;
+    int bin;
+
+    m->acc = 0;
+    m->block_n = 0;
+    if (ms <= 0) {
+        return;
+    }
+    l = -0.691f + 10.0f * log10f(ms);
+    if (l <= LOUD_ABS_GATE) {
+        return;
+    }
+    bin = (l - LOUD_ABS_GATE) * 2;
+    if (bin >= MUSIC_LOUD_BINS) {
+        bin = MUSIC_LOUD_BINS - 1;
+    }
+    if (m->hist[bin] < 0xffff) {
+        m->hist[bin]++;
+        m->blocks++;
+    }
+}
+
+//gate以上的块按能量平均，返回参与的块数
+static u32 music_loud_gated(const struct music_loud *m, float gate, float *lufs)
+{
+    float e = 0;
+    u32 n = 0;
+
+    for (int i = 0; i < MUSIC_LOUD_BINS; i++) {
+        if (!m->hist[i] || BIN_LUFS(i) < gate) {
+            continue;
+        }
+        e += m->hist[i] * powf(10.0f, BIN_LUFS(i) / 10.0f);
+        n += m->hist[i];
+    }
+    if (n) {
+        *lufs = 10.0f * log10f(e / n);
+    }
+    return n;
+}
+
+void music_loud_init(struct music_loud *m)
+{
+    memset(m, 0, sizeof(*m));
+}
+
+//交错排列的16位PCM，解码回调里边放边喂
+void music_loud_feed(struct music_loud *m, const s16 *pcm, int frames, int ch, u32 sample_rate)
+{
+    int nch = ch < MUSIC_LOUD_CHANNELS ? ch : MUSIC_LOUD_CHANNELS;
+    const s16 *f;
+    float x, y;
+    int i;
+
+    if (sample_rate != m->sample_rate) {
+        music_loud_setup(m, sample_rate);
+    }
+    for (i = 0; i < frames * ch; i++) {
+        int a = pcm[i] < 0 ? -pcm[i] : pcm[i];
+        if (a > m->peak) {
+            m->peak = a;
+        }
+    }
+    for (i = m->phase; i < frames; i += m->decim) {
+        f = pcm + i * ch;
+        for (int c = 0; c < nch; c++) {
+            x = f[c] * (1.0f / 32768);
+            y = m->shelf_a * (m->shelf_y[c] + x - m->shelf_x[c]);
+            m->shelf_x[c] = x;
+            m->shelf_y[c] = y;
+            x += LOUD_SHELF_GAIN * y;
+            y = m->hp_a * (m->hp_y[c] + x - m->hp_x[c]);
+            m->hp_x[c] = x;
+            m->hp_y[c] = y;
+            m->acc += y * y;
+        }
+        if (++m->block_n >= m->block_len) {
+            music_loud_block(m);
+        }
+    }
+    m->phase = i - frames;
+}
+
+//测够了返回0，gain为归一化到目标响度要加的增益(0.01dB)
+int music_loud_result(const struct music_loud *m, s16 *gain)
+{
+    float lufs, g;
+
+    if (m->blocks < MUSIC_LOUD_MIN_SEC * 1000 / MUSIC_LOUD_BLOCK_MS) {
+        return -1;
+    }
+    if (!music_loud_gated(m, LOUD_ABS_GATE, &lufs) ||
+        !music_loud_gated(m, lufs + LOUD_REL_GATE, &lufs)) {
+        return -1;
+    }
+    g = (MUSIC_LOUD_TARGET - lufs) * 100;
+    if (g < MUSIC_LOUD_GAIN_MIN) {
+        g = MUSIC_LOUD_GAIN_MIN;
+    } else if (g > MUSIC_LOUD_GAIN_MAX) {
+        g = MUSIC_LOUD_GAIN_MAX;
+    }
+    //正增益不超过峰值到满幅的余量，峰值已经满幅的不放大
+    if (g > 0 && m->peak) {
+        float head = -2000.0f * log10f(m->peak / 32768.0f) - MUSIC_LOUD_PEAK_MARGIN;
+        if (g > head) {
+            g = head > 0 ? head : 0;
+        }
+    }
+    *gain = g;
+    log_info("integrated %d.%02d LUFS, peak %d, gain %d", (int)lufs, (int)(-lufs * 100) % 100, m->peak, *gain);
+
+    return 0;
+}
+
+//0.01dB换成混音级的Q12增益
+int music_loud_gain_q12(s16 gain)
+{
+    return powf(10.0f, gain / 2000.0f) * 4096 + 0.5f;
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*
+@file: music_loud.h
+@brief: 音乐响度测量，按EBU R128积分响度的简化算法给出归一化增益
+@date: 2026/10/19
+*/
+#ifndef _MUSIC_LOUD_H_
+#define _MUSIC_LOUD_H_
+
+#include "os/os_api.h"
+#include "app_config.h"
+
+#define MUSIC_LOUD_ENABLE       // 响度归一化开关
+
+#ifdef MUSIC_LOUD_ENABLE
+
+#define MUSIC_LOUD_RATE         8000            // 抽取后的分析采样率，不低于这个
+#define MUSIC_LOUD_CHANNELS     2               // 只按前两个声道算
+#define MUSIC_LOUD_BLOCK_MS     400             // 响度块长度
+#define MUSIC_LOUD_BINS         140             // 块响度直方图，-70到0 LUFS每格0.5 LU
+#define MUSIC_LOUD_MIN_SEC      30              // 测够这么久才给结果，跳过的曲目测到一半也能用
+#define MUSIC_LOUD_TARGET       (-18.0f)        // 归一化到的积分响度(LUFS)
+#define MUSIC_LOUD_GAIN_MIN     (-1200)         // 增益范围，0.01dB为单位
+#define MUSIC_LOUD_GAIN_MAX     600
+#define MUSIC_LOUD_PEAK_MARGIN  100             // 正增益按峰值限时留的余量(0.01dB)，样点峰值比真峰值低、也可能只测了一部分
+
+struct music_loud {
+    u32 sample_rate;                // 系数对应的采样率，变了重算
+    int decim;                      // 每decim帧取一帧
+    int phase;
+    int block_len;                  // 每块抽取后的帧数
+    int block_n;
+    float acc;                      // 当前块的能量和
+    float shelf_a;                  // 高架前的一阶高通系数
+    float hp_a;                     // 低频高通系数
+    float shelf_x[MUSIC_LOUD_CHANNELS];
+    float shelf_y[MUSIC_LOUD_CHANNELS];
+    float hp_x[MUSIC_LOUD_CHANNELS];
+    float hp_y[MUSIC_LOUD_CHANNELS];
+    u32 blocks;                     // 过了绝对门限的块数
+    u16 peak;                       // 测过部分的样点峰值(绝对值)
+    u16 hist[MUSIC_LOUD_BINS];
+};
+
+void music_loud_init(struct music_loud *m);
+void music_loud_feed(struct music_loud *m, const s16 *pcm, int frames, int ch, u32 sample_rate);
+int music_loud_result(const struct music_loud *m, s16 *gain);
+int music_loud_gain_q12(s16 gain);
+
+#endif
+
+#endif
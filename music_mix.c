@@ -0,0 +1,245 @@
+/*
+@file: music_mix.c
+@brief: 解码输出混音级
+        每路音乐解码器的输出在解码回调里原地乘增益，再由解码器交给DAC；
+        这里只管增益，叠加靠SDK：同时在放的解码器(两路音乐和提示音)输出到同一个DAC时，
+        audio_server按帧相加后再送DAC，不按优先级抢占；交叉淡化一降一升、提示音压低音乐都依赖这一点，
+        换SDK或改了解码输出方式(不同sample_source、独占DAC)要先确认，否则淡化会变成硬切、压低没有意义；
+        每路有一个切歌淡入淡出斜坡和一个提示音压低斜坡，按帧线性过渡，斜坡长度按回调给的采样率换算，精确到帧；
+        不在斜坡上时整块用同一个增益，为1时直接跳过；乘完按16位饱和；
+        两个斜坡和曲目的响度增益并成一个增益，每个样本仍只乘一次；没测过响度的曲目在乘增益前顺便测
+@date: 2026/10/19
+*/
+
+#include "os/os_api.h"
+#include "app_config.h"
+#include "music_mix.h"
+
+#ifdef MUSIC_MIX_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[MUSIC_MIX]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+#define GAIN_SHIFT      24                      // 斜坡按Q24走，乘样本时取Q12
+#define GAIN_ONE        (1 << GAIN_SHIFT)
+#define GAIN_Q24(g)     ((s32)(g) << (GAIN_SHIFT - 12))
+
+//target/ms/seq由控制方写，其余只在解码回调里改
+struct music_mix_ramp {
+    s32 gain;                       // 当前增益
+    s32 step;                       // 每帧增量
+    s32 end;                        // 斜坡终点，走完时直接落到这里，不累积误差
+    u32 remain;                     // 还要走的帧数
+    s32 target;
+    u16 ms;
+    u8 seq;                         // 控制方每发一次命令加一
+    u8 done;                        // 回调已接手的命令序号
+};
+
+struct music_mix_input {
+    struct music_mix_ramp fade;     // 切歌淡入淡出
+    struct music_mix_ramp duck;     // 提示音压低，两路一起设，各自在自己的回调里走
+    volatile s32 level;             // 曲目响度增益，Q12，解码开始前设好
+#ifdef MUSIC_LOUD_ENABLE
+    volatile u8 measure;
+    struct music_loud loud;
+#endif
+};
+
+#define RAMP_UNITY      { .gain = GAIN_ONE, .end = GAIN_ONE, .target = GAIN_ONE }
+
+static struct music_mix_input mix_in[MUSIC_MIX_INPUTS] = {
+    { RAMP_UNITY, RAMP_UNITY, MUSIC_MIX_UNITY },
+    { RAMP_UNITY, RAMP_UNITY, MUSIC_MIX_UNITY },
+};
+
+static void music_mix_ramp_set(struct music_mix_ramp *r, int gain, int ms)
+{
+    local_irq_disable();
+    r->target = GAIN_Q24(gain);
+    r->ms = ms;
+    r->seq++;
+    local_irq_enable();
+}
+
+//接手控制方的新命令，从当前增益开始走
+static void music_mix_ramp_load(struct music_mix_ramp *r, u32 sample_rate)
+{
+    s32 target;
+    u32 frames;
+
+    if (r->done == r->seq) {
+        return;
+    }
+    local_irq_disable();
+    target = r->target;
+    frames = (u32)r->ms * sample_rate / 1000;
+    r->done = r->seq;
+    local_irq_enable();
+
+    r->end = target;
+    if (frames == 0) {
+        r->gain = target;
+        r->remain = 0;
+        return;
+    }
+    r->step = (target - r->gain) / (s32)frames;
+    r->remain = frames;
+    log_info("ramp %d -> %d in %d frames", r->gain >> 12, target >> 12, frames);
+}
+
+static inline s32 music_mix_ramp_next(struct music_mix_ramp *r)
+{
+    if (r->remain) {
+        if (--r->remain) {
+            r->gain += r->step;
+        } else {
+            r->gain = r->end;
+        }
+    }
+    return r->gain;
+}
+
+static inline s16 music_mix_sat(s32 v)
+{
+    if (v > 32767) {
+        return 32767;
+    }
+    if (v < -32768) {
+        return -32768;
+    }
+    return v;
+}
+
+//两个Q24斜坡增益和Q12响度增益相乘取Q12
+static inline s32 music_mix_gain(s32 fade, s32 duck, s32 level)
+{
+    return ((((fade >> 12) * (duck >> 12)) >> 12) * level) >> 12;
+}
+
+static void music_mix_process(struct music_mix_input *in, s16 *pcm, int frames, int ch, u32 sample_rate)
+{
+    s32 level = in->level;
+    s32 g;
+
+#ifdef MUSIC_LOUD_ENABLE
+    if (in->measure) {
+        music_loud_feed(&in->loud, pcm, frames, ch, sample_rate);
+    }
+#endif
+    music_mix_ramp_load(&in->fade, sample_rate);
+    music_mix_ramp_load(&in->duck, sample_rate);
+
+    //斜坡上逐帧算增益
+    while (frames > 0 && (in->fade.remain || in->duck.remain)) {
+        g = music_mix_gain(music_mix_ramp_next(&in->fade), music_mix_ramp_next(&in->duck), level);
+        for (int c = 0; c < ch; c++, pcm++) {
+            *pcm = music_mix_sat((*pcm * g) >> 12);
+        }
+        frames--;
+    }
+    if (frames <= 0) {
+        return;
+    }
+
+    g = music_mix_gain(in->fade.gain, in->duck.gain, level);
+    if (g == MUSIC_MIX_UNITY) {
+        return;
+    }
+    for (int i = frames * ch; i > 0; i--, pcm++) {
+        *pcm = music_mix_sat((*pcm * g) >> 12);
+    }
+}
+
+static int music_mix_dec_callback0(u8 *buf, u32 len, u32 sample_rate, u8 ch_num)
+{
+    int ch = ch_num ? ch_num : 1;
+
+    music_mix_process(&mix_in[0], (s16 *)buf, len / 2 / ch, ch, sample_rate);
+    return 0;
+}
+
+static int music_mix_dec_callback1(u8 *buf, u32 len, u32 sample_rate, u8 ch_num)
+{
+    int ch = ch_num ? ch_num : 1;
+
+    music_mix_process(&mix_in[1], (s16 *)buf, len / 2 / ch, ch, sample_rate);
+    return 0;
+}
+
+//这一路马上回到增益1，打开新曲目时用
+void music_mix_reset(int in)
+{
+    music_mix_fade(in, MUSIC_MIX_UNITY, 0);
+}
+
+//gain按MUSIC_MIX_UNITY为1，ms为0时下一块直接生效
+void music_mix_fade(int in, int gain, int ms)
+{
+    if (in < 0 || in >= MUSIC_MIX_INPUTS) {
+        return;
+    }
+    music_mix_ramp_set(&mix_in[in].fade, gain, ms);
+}
+
+//曲目的响度增益，在这一路解码开始前设
+void music_mix_level(int in, int gain)
+{
+    if (in < 0 || in >= MUSIC_MIX_INPUTS) {
+        return;
+    }
+    mix_in[in].level = gain;
+}
+
+#ifdef MUSIC_LOUD_ENABLE
+//开始/停止测这一路正在放的曲目，开始时清掉上一首的数据
+void music_mix_measure(int in, int on)
+{
+    if (in < 0 || in >= MUSIC_MIX_INPUTS) {
+        return;
+    }
+    mix_in[in].measure = 0;
+    if (on) {
+        music_loud_init(&mix_in[in].loud);
+        mix_in[in].measure = 1;
+    }
+}
+
+//测够了返回0和归一化增益(0.01dB)，不再接着测
+int music_mix_loudness(int in, s16 *gain)
+{
+    if (in < 0 || in >= MUSIC_MIX_INPUTS || !mix_in[in].measure) {
+        return -1;
+    }
+    mix_in[in].measure = 0;
+    return music_loud_result(&mix_in[in].loud, gain);
+}
+#endif
+
+//提示音开始/结束时调用，所有音乐输入一起压低/恢复，压下快、放开慢
+void music_mix_duck(int on)
+{
+    for (int i = 0; i < MUSIC_MIX_INPUTS; i++) {
+        music_mix_ramp_set(&mix_in[i].duck, on ? MUSIC_MIX_DUCK_GAIN : MUSIC_MIX_UNITY,
+                           on ? MUSIC_MIX_DUCK_ATTACK_MS : MUSIC_MIX_DUCK_RELEASE_MS);
+    }
+}
+
+//填到解码请求的dec_callback，第in路的增益作用在这个解码器上
+music_mix_callback_t music_mix_callback(int in)
+{
+    static const music_mix_callback_t cb[MUSIC_MIX_INPUTS] = {
+        music_mix_dec_callback0,
+        music_mix_dec_callback1,
+    };
+
+    if (in < 0 || in >= MUSIC_MIX_INPUTS) {
+        return NULL;
+    }
+    return cb[in];
+}
+
+#endif
@@ -0,0 +1,37 @@
+/*
+@file: music_mix.h
+@brief: 解码输出混音级，切歌交叉淡化、提示音压低音乐和响度增益
+@date: 2026/10/19
+*/
+#ifndef _MUSIC_MIX_H_
+#define _MUSIC_MIX_H_
+
+#include "os/os_api.h"
+#include "app_config.h"
+#include "music_loud.h"
+
+#define MUSIC_MIX_ENABLE        // 混音级开关：音乐解码输出按路加增益斜坡
+
+#ifdef MUSIC_MIX_ENABLE
+
+#define MUSIC_MIX_INPUTS        2               // 两路音乐，对应当前和预开的两个解码器
+#define MUSIC_MIX_UNITY         4096            // 增益1.0
+#define MUSIC_MIX_DUCK_GAIN     (MUSIC_MIX_UNITY / 4)   // 提示音期间音乐压到-12dB
+#define MUSIC_MIX_DUCK_ATTACK_MS    50
+#define MUSIC_MIX_DUCK_RELEASE_MS   300
+
+typedef int (*music_mix_callback_t)(u8 *buf, u32 len, u32 sample_rate, u8 ch_num);
+
+void music_mix_reset(int in);
+void music_mix_fade(int in, int gain, int ms);
+void music_mix_level(int in, int gain);
+#ifdef MUSIC_LOUD_ENABLE
+void music_mix_measure(int in, int on);
+int music_mix_loudness(int in, s16 *gain);
+#endif
+void music_mix_duck(int on);
+music_mix_callback_t music_mix_callback(int in);
+
+#endif
+
+#endif
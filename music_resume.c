@@ -0,0 +1,134 @@
+/*
+@file: music_resume.c
+@brief: 本地音乐断点记忆
+        当前曲目的完整路径和解码器断点按定长记录顺序追加到内置flash的几个扇区里，
+        写到扇区开头才擦这个扇区，各扇区轮流擦写；开机扫描记录区取序号最大的有效记录，
+        不用等目录扫描就能直接打开文件接着播；掉电写坏的记录CRC不对，自动用上一条
+@date: 2026/10/19
+*/
+
+#include <stddef.h>
+#include "os/os_api.h"
+#include "app_config.h"
+#include "asm/sfc_norflash_api.h"
+#include "music_resume.h"
+#include "file_util.h"
+
+#ifdef MUSIC_RESUME_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[MUSIC_RESUME]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+#define REC_COUNT       (MUSIC_RESUME_SECTORS * MUSIC_RESUME_SECTOR_SIZE / MUSIC_RESUME_REC_SIZE)
+#define REC_ADDR(i)     (MUSIC_RESUME_FLASH_ADDR + (i) * MUSIC_RESUME_REC_SIZE)
+
+static int resume_slot = -1;        // 下一条写入位置，-1还没扫描过
+static s8 resume_area_ok = -1;      // 记录区是否落在flash容量内，-1还没查过
+static u32 resume_seq;
+static struct music_resume scratch;
+
+static int music_resume_valid(const struct music_resume *r)
+{
+    return r->magic == MUSIC_RESUME_MAGIC && r->path_len < MUSIC_RESUME_PATH_MAX &&
+           r->bp_len <= MUSIC_RESUME_BP_MAX &&
+           r->crc == file_crc32(0, r, offsetof(struct music_resume, crc));
+}
+
+//扫一遍记录区，找出最新一条，定下一条的写入位置
+static int music_resume_scan(struct music_resume *latest)
+{
+    int found = -1;
+
+    for (int i = 0; i < REC_COUNT; i++) {
+        norflash_read(NULL, &scratch, sizeof(scratch), REC_ADDR(i));
+        if (!music_resume_valid(&scratch)) {
+            continue;
+        }
+        if (found < 0 || (int)(scratch.seq - resume_seq) > 0) {
+            found = i;
+            resume_seq = scratch.seq;
+            if (latest) {
+                memcpy(latest, &scratch, sizeof(scratch));
+            }
+        }
+    }
+    resume_slot = found < 0 ? 0 : (found + 1) % REC_COUNT;
+    log_info("scan: latest %d seq %d", found, resume_seq);
+
+    return found;
+}
+
+//写入位置不是擦过的空白(上次掉电写了一半)，跳到下一个扇区开头
+static int music_resume_slot_blank(int slot)
+{
+    const u32 *p = (const u32 *)&scratch;
+
+    norflash_read(NULL, &scratch, sizeof(scratch), REC_ADDR(slot));
+    for (int i = 0; i < sizeof(scratch) / 4; i++) {
+        if (p[i] != 0xffffffff) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int music_resume_load(struct music_resume *r)
+{
+    return music_resume_scan(r) < 0 ? -1 : 0;
+}
+
+//第一次擦之前确认整个环都在flash里，配置错了宁可不存
+static int music_resume_area_check(void)
+{
+    u32 cap = 0;
+
+    if (resume_area_ok < 0) {
+        norflash_ioctl(NULL, IOCTL_GET_CAPACITY, (u32)&cap);
+        resume_area_ok = cap && MUSIC_RESUME_FLASH_ADDR + MUSIC_RESUME_SECTORS * MUSIC_RESUME_SECTOR_SIZE <= cap;
+        if (!resume_area_ok) {
+            log_e("music resume area 0x%x out of flash 0x%x\n", MUSIC_RESUME_FLASH_ADDR, cap);
+        }
+    }
+    return resume_area_ok ? 0 : -1;
+}
+
+int music_resume_save(struct music_resume *r)
+{
+    const int per_sector = MUSIC_RESUME_SECTOR_SIZE / MUSIC_RESUME_REC_SIZE;
+    u32 addr;
+
+    if (music_resume_area_check()) {
+        return -1;
+    }
+    if (resume_slot < 0) {
+        music_resume_scan(NULL);
+    }
+    if (resume_slot % per_sector && !music_resume_slot_blank(resume_slot)) {
+        resume_slot = (resume_slot / per_sector + 1) * per_sector % REC_COUNT;
+    }
+    addr = REC_ADDR(resume_slot);
+    if (resume_slot % per_sector == 0) {
+        norflash_ioctl(NULL, IOCTL_ERASE_SECTOR, addr);
+    }
+
+    r->magic = MUSIC_RESUME_MAGIC;
+    r->seq = ++resume_seq;
+    r->crc = file_crc32(0, r, offsetof(struct music_resume, crc));
+    norflash_write(NULL, r, sizeof(*r), addr);
+    //读回校验，写坏的这条下次扫描时会被跳过
+    norflash_read(NULL, &scratch, sizeof(scratch), addr);
+    if (memcmp(&scratch, r, sizeof(*r))) {
+        log_e("music resume write err\n");
+        resume_slot = (resume_slot + 1) % REC_COUNT;
+        return -1;
+    }
+    log_info("save slot %d seq %d track %d fptr %d", resume_slot, r->seq, r->track, r->bp_fptr);
+    resume_slot = (resume_slot + 1) % REC_COUNT;
+
+    return 0;
+}
+
+#endif
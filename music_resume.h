@@ -0,0 +1,69 @@
+/*
+@file: music_resume.h
+@brief: 本地音乐断点记忆，存在内置flash的磨损均衡环形区
+@date: 2026/10/19
+*/
+#ifndef _MUSIC_RESUME_H_
+#define _MUSIC_RESUME_H_
+
+#include "os/os_api.h"
+#include "app_config.h"
+
+#define MUSIC_RESUME_ENABLE     // 断点记忆开关
+
+#ifdef MUSIC_RESUME_ENABLE
+
+//记录区必须在isd_config.ini里单独预留，起始地址和大小由工程配置给出，这里不给默认值；
+//flash末尾一般是VM/syscfg和资源区，写错地址会擦掉固件或设置
+#ifndef CONFIG_MUSIC_RESUME_FLASH_ADDR
+#error "music resume: define CONFIG_MUSIC_RESUME_FLASH_ADDR to a flash area reserved in isd_config.ini"
+#endif
+#ifndef CONFIG_MUSIC_RESUME_FLASH_SIZE
+#error "music resume: define CONFIG_MUSIC_RESUME_FLASH_SIZE to the size of the reserved area"
+#endif
+#define MUSIC_RESUME_FLASH_ADDR CONFIG_MUSIC_RESUME_FLASH_ADDR
+#define MUSIC_RESUME_FLASH_SIZE CONFIG_MUSIC_RESUME_FLASH_SIZE
+#define MUSIC_RESUME_SECTOR_SIZE 4096
+#define MUSIC_RESUME_SECTORS    4           // 记录区扇区数，轮流擦写
+#define MUSIC_RESUME_REC_SIZE   512         // 每条记录大小，每扇区8条
+#define MUSIC_RESUME_SAVE_SEC   30          // 播放中保存断点的间隔
+//每个扇区每 扇区数*每扇区条数*间隔 = 16分钟才擦一次，按10万次擦写寿命约可连续播放3年
+#define MUSIC_RESUME_MAGIC      0x4D535552  // "RUSM"
+#define MUSIC_RESUME_PATH_MAX   256
+#define MUSIC_RESUME_BP_MAX     200         // 解码器断点数据上限，超出只记曲目不记位置
+
+#if MUSIC_RESUME_FLASH_ADDR % MUSIC_RESUME_SECTOR_SIZE
+#error "music resume: reserved area must start on a sector boundary"
+#endif
+#if MUSIC_RESUME_SECTORS * MUSIC_RESUME_SECTOR_SIZE > MUSIC_RESUME_FLASH_SIZE
+#error "music resume: ring does not fit in the reserved area"
+#endif
+
+struct music_resume {
+    u32 magic;
+    u32 seq;                        // 递增序号，最大的是最新一条
+    u32 sclust;                     // 和size一起确认还是同一个文件
+    u32 size;
+    int track;                      // 在媒体库索引里的序号，索引重建过要重新定位
+    u16 path_len;
+    u16 bp_len;                     // 0表示从头播放
+    u32 bp_fptr;
+    u32 skip_from;                  // 按跳转表跳过之后的断点，续播时要按同样的方式打开
+    u32 skip_to;
+    u32 time_base;                  // 跳转到的秒数，解码器的播放时间从这里算起
+    u32 shuffle_seed;               // 随机播放的顺序，0表示顺序播放
+    u16 shuffle_first;
+    u16 shuffle_count;
+    s16 shuffle_anchor;
+    s16 shuffle_pos;
+    char path[MUSIC_RESUME_PATH_MAX];       // 完整路径，开机不用扫描直接打开
+    u8 bp_data[MUSIC_RESUME_BP_MAX];
+    u32 crc;
+};
+
+int music_resume_load(struct music_resume *r);
+int music_resume_save(struct music_resume *r);
+
+#endif
+
+#endif
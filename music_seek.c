@@ -0,0 +1,686 @@
+/*
+@file: music_seek.c
+@brief: 本地音乐跳转表
+        后台任务按媒体库索引的顺序把每首歌扫一遍，记下均分时间点所在帧的文件偏移：
+        MP3/AAC(ADTS)逐帧走帧头，FLAC读SEEKTABLE，WAV按字节率直接算；
+        表按曲目序号定长存在卷根目录，建索引时就占好大小，之后原地改写；
+        重建索引时同一文件的表跟着文件挪到新序号，不用重扫；
+        跳转时查一条表直接得到偏移，不用解码器逐帧快进，VBR文件也准；
+        只有文件头结构本身自相矛盾(WAV有RIFF头却缺fmt/data块、FLAC的STREAMINFO采样率为0)才在索引里记为坏文件；
+        找不到帧同步、没有fLaC头这类可能只是扫描认不出来的(自由码率MP3、ADIF格式AAC等)只当不支持跳转
+@date: 2026/10/19
+*/
+
+#include <stddef.h>
+#include "os/os_api.h"
+#include "app_config.h"
+#include "fs/fs.h"
+#include "server/audio_server.h"
+#include "music_index.h"
+#include "music_seek.h"
+#include "file_util.h"
+
+#if defined(MUSIC_SEEK_ENABLE) && defined(MUSIC_INDEX_ENABLE)
+
+#if 0
+#define log_info(x, ...)    printf("\n[MUSIC_SEEK]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+#define SLOT_SIZE       sizeof(struct music_seek_slot)
+
+//带缓冲的顺序读，帧头都很短，一次读一段
+struct music_seek_reader {
+    FILE *file;
+    u32 file_len;
+    u32 base;
+    u32 len;
+    u8 buf[MUSIC_SEEK_BUF_SIZE];
+};
+
+//先按细粒度记点，点数满了对半合并
+struct music_seek_collect {
+    u32 step;
+    int n;
+    u32 last_off;
+    u32 pt[MUSIC_SEEK_FINE_MAX];
+};
+
+//扫描结果，SEEK_BAD表示文件头结构确定损坏，拿不准的一律SEEK_NONE
+enum {
+    SEEK_OK = 0,
+    SEEK_NONE = -1,                 // 解析不了或格式不支持跳转
+    SEEK_BAD = -2,
+};
+
+struct music_seek_builder {
+    const char *root;
+    FILE *fp;
+    struct music_index *ix;         // 播放用的索引，读写有锁
+    volatile u8 exit;
+    OS_SEM sem;
+    int pid;
+    struct music_seek_reader rd;
+    struct music_seek_collect col;
+};
+
+static struct music_seek_builder *seek_builder;
+static OS_MUTEX seek_mutex;         // 后台写表和查表互斥
+static u8 seek_mutex_init;
+
+static const u16 mp3_bitrate[5][15] = {
+    {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},     // V1 L1
+    {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},        // V1 L2
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},         // V1 L3
+    {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},        // V2 L1
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},             // V2 L2/L3
+};
+
+static const u32 adts_sample_rate[13] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350,
+};
+
+static u32 music_seek_be32(const u8 *p)
+{
+    return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+}
+
+static u32 music_seek_le32(const u8 *p)
+{
+    return ((u32)p[3] << 24) | ((u32)p[2] << 16) | ((u32)p[1] << 8) | p[0];
+}
+
+static void music_seek_path(char *buf, int size, const char *root)
+{
+    snprintf(buf, size, "%s%s", root, MUSIC_SEEK_FILE);
+}
+
+static u32 music_seek_slot_crc(const struct music_seek_slot *s)
+{
+    return file_crc32(0, s, offsetof(struct music_seek_slot, crc));
+}
+
+static int music_seek_read_slot(FILE *fp, int track, struct music_seek_slot *s)
+{
+    fseek(fp, track * SLOT_SIZE, SEEK_SET);
+    if (fread(s, SLOT_SIZE, 1, fp) != SLOT_SIZE || s->crc != music_seek_slot_crc(s)) {
+        return -1;
+    }
+    return 0;
+}
+
+//超出文件长度、读失败或要退出返回SEEK_NONE
+static int music_seek_reader_peek(struct music_seek_builder *b, u32 offset, u8 *out, u32 len)
+{
+    struct music_seek_reader *r = &b->rd;
+    int n;
+
+    if (offset + len > r->file_len) {
+        return SEEK_NONE;
+    }
+    if (offset < r->base || offset + len > r->base + r->len) {
+        if (b->exit) {
+            return SEEK_NONE;
+        }
+#if CONFIG_DEC_DECRYPT_ENABLE
+        extern const struct audio_vfs_ops *get_decrypt_vfs_ops(void);
+        const struct audio_vfs_ops *ops = get_decrypt_vfs_ops();
+        ops->fseek(r->file, offset, SEEK_SET);
+        n = ops->fread(r->file, r->buf, MIN(sizeof(r->buf), r->file_len - offset));
+#else
+        fseek(r->file, offset, SEEK_SET);
+        n = fread(r->buf, MIN(sizeof(r->buf), r->file_len - offset), 1, r->file);
+#endif
+        r->base = offset;
+        r->len = n > 0 ? n : 0;
+        if (len > r->len) {
+            return SEEK_NONE;
+        }
+    }
+    memcpy(out, r->buf + (offset - r->base), len);
+
+    return 0;
+}
+
+static void music_seek_collect_init(struct music_seek_collect *c, u32 first_off)
+{
+    c->step = MUSIC_SEEK_FINE_MS;
+    c->n = 0;
+    c->last_off = first_off;
+}
+
+//ms时刻开始的一帧在off，之前还没记的时间点都落在上一帧里
+static void music_seek_collect_add(struct music_seek_collect *c, u32 ms, u32 off)
+{
+    while ((u32)c->n * c->step < ms) {
+        if (c->n == MUSIC_SEEK_FINE_MAX) {
+            for (int i = 0; i < c->n / 2; i++) {
+                c->pt[i] = c->pt[i * 2];
+            }
+            c->n /= 2;
+            c->step *= 2;
+            continue;
+        }
+        c->pt[c->n++] = c->last_off;
+    }
+    c->last_off = off;
+}
+
+//细粒度的点按整数倍抽成定长表
+static int music_seek_collect_done(struct music_seek_collect *c, struct music_seek_slot *s)
+{
+    int r;
+
+    if (c->n == 0) {
+        return -1;
+    }
+    r = (c->n + MUSIC_SEEK_POINTS - 1) / MUSIC_SEEK_POINTS;
+    s->step_ms = c->step * r;
+    s->count = (c->n + r - 1) / r;
+    for (int k = 0; k < s->count; k++) {
+        s->point[k] = c->pt[k * r];
+    }
+    return 0;
+}
+
+//MP3帧头，返回帧长，不是帧头返回0
+static u32 music_seek_mp3_frame(const u8 *h, u32 *sample_rate, u32 *samples)
+{
+    static const u16 rates[3] = {44100, 48000, 32000};
+    u32 hdr = music_seek_be32(h);
+    int ver = (hdr >> 19) & 3;      // 3:V1 2:V2 0:V2.5
+    int layer = (hdr >> 17) & 3;    // 3:L1 2:L2 1:L3
+    int br = (hdr >> 12) & 15;
+    int sr = (hdr >> 10) & 3;
+    int pad = (hdr >> 9) & 1;
+    u32 kbps;
+
+    if ((hdr >> 21) != 0x7ff || ver == 1 || layer == 0 || br == 0 || br == 15 || sr == 3) {
+        return 0;
+    }
+    *sample_rate = rates[sr] >> (ver == 3 ? 0 : (ver == 2 ? 1 : 2));
+    if (ver == 3) {
+        kbps = mp3_bitrate[3 - layer][br];
+    } else {
+        kbps = mp3_bitrate[layer == 3 ? 3 : 4][br];
+    }
+    if (layer == 3) {
+        *samples = 384;
+        return (12 * kbps * 1000 / *sample_rate + pad) * 4;
+    }
+    *samples = (layer == 1 && ver != 3) ? 576 : 1152;
+    return *samples / 8 * kbps * 1000 / *sample_rate + pad;
+}
+
+//AAC ADTS帧头
+static u32 music_seek_adts_frame(const u8 *h, u32 *sample_rate, u32 *samples)
+{
+    int sr = (h[2] >> 2) & 15;
+    u32 len = ((h[3] & 3) << 11) | (h[4] << 3) | (h[5] >> 5);
+
+    if (h[0] != 0xff || (h[1] & 0xf6) != 0xf0 || sr >= ARRAY_SIZE(adts_sample_rate) || len < 7) {
+        return 0;
+    }
+    *sample_rate = adts_sample_rate[sr];
+    *samples = 1024 * ((h[6] & 3) + 1);
+    return len;
+}
+
+//文件开头ID3v2标签的长度，没有标签返回0
+static int music_seek_id3_len(struct music_seek_builder *b, u32 *len)
+{
+    u8 h[10];
+    int err;
+
+    *len = 0;
+    if ((err = music_seek_reader_peek(b, 0, h, sizeof(h)))) {
+        return err;
+    }
+    if (!memcmp(h, "ID3", 3)) {
+        *len = 10 + ((h[6] & 0x7f) << 21) + ((h[7] & 0x7f) << 14) + ((h[8] & 0x7f) << 7) + (h[9] & 0x7f);
+        if (h[5] & 0x10) {
+            *len += 10;
+        }
+    }
+    return 0;
+}
+
+//逐帧走帧头，开头的ID3v2跳过，遇到不是帧头的(如ID3v1)就结束
+static int music_seek_scan_frames(struct music_seek_builder *b, struct music_seek_slot *s,
+                                  u32 (*frame)(const u8 *, u32 *, u32 *))
+{
+    struct music_seek_collect *c = &b->col;
+    u8 h[7];
+    u32 off, lim, len, sr, sr2, spf;
+    u64 samples = 0;
+    int err;
+
+    if ((err = music_seek_id3_len(b, &off))) {
+        return err;
+    }
+
+    //连着两个帧头对得上才算找到第一帧；找不到也可能是自由码率MP3或ADIF格式AAC，只当不支持跳转
+    for (lim = off + MUSIC_SEEK_SYNC_MAX; off < lim; off++) {
+        if ((err = music_seek_reader_peek(b, off, h, 7))) {
+            return err;
+        }
+        len = frame(h, &sr, &spf);
+        if (len && !music_seek_reader_peek(b, off + len, h, 7) &&
+            frame(h, &sr2, &spf) && sr2 == sr) {
+            break;
+        }
+    }
+    if (off >= lim) {
+        return SEEK_NONE;
+    }
+
+    //跳转后从帧边界直接接着读，文件头不用留
+    s->hdr_len = 0;
+    music_seek_collect_init(c, off);
+    while (!music_seek_reader_peek(b, off, h, 7) && (len = frame(h, &sr2, &spf))) {
+        music_seek_collect_add(c, samples * 1000 / sr, off);
+        samples += spf;
+        off += len;
+    }
+    if (b->exit) {
+        return -1;
+    }
+    music_seek_collect_add(c, samples * 1000 / sr, 0);
+
+    return music_seek_collect_done(c, s);
+}
+
+//FLAC按SEEKTABLE，没有SEEKTABLE的不支持；开头带ID3v2标签的跳过标签
+static int music_seek_scan_flac(struct music_seek_builder *b, struct music_seek_slot *s)
+{
+    struct music_seek_collect *c = &b->col;
+    u8 h[18];
+    u32 off, len, sr = 0, table = 0, points = 0;
+    u64 total = 0, sample, pos;
+    u8 last, info = 0;
+    int err;
+
+    if ((err = music_seek_id3_len(b, &off)) ||
+        (err = music_seek_reader_peek(b, off, h, 4))) {
+        return err;
+    }
+    if (memcmp(h, "fLaC", 4)) {
+        return SEEK_NONE;
+    }
+    off += 4;
+    do {
+        if ((err = music_seek_reader_peek(b, off, h, 4))) {
+            return err;
+        }
+        last = h[0] & 0x80;
+        len = (h[1] << 16) | (h[2] << 8) | h[3];
+        if ((h[0] & 0x7f) == 0 && !music_seek_reader_peek(b, off + 4 + 10, h, 8)) {
+            //STREAMINFO：20位采样率，36位总采样数(0表示未知)
+            info = 1;
+            sr = (h[0] << 12) | (h[1] << 4) | (h[2] >> 4);
+            total = ((u64)(h[3] & 0x0f) << 32) | music_seek_be32(h + 4);
+        } else if ((h[0] & 0x7f) == 3) {
+            table = off + 4;
+            points = len / 18;
+        }
+        off += 4 + len;
+    } while (!last);
+    if (info && !sr) {
+        return SEEK_BAD;
+    }
+    if (!sr || !total || !points) {
+        return SEEK_NONE;
+    }
+
+    //文件头是所有元数据块，解码器要靠STREAMINFO
+    s->hdr_len = off;
+    music_seek_collect_init(c, off);
+    for (int i = 0; i < points; i++) {
+        if (music_seek_reader_peek(b, table + i * 18, h, 18)) {
+            return -1;
+        }
+        sample = ((u64)music_seek_be32(h) << 32) | music_seek_be32(h + 4);
+        pos = ((u64)music_seek_be32(h + 8) << 32) | music_seek_be32(h + 12);
+        if (sample == ~0ULL || sample >= total) {
+            continue;       //占位点
+        }
+        music_seek_collect_add(c, sample * 1000 / sr, off + pos);
+    }
+    music_seek_collect_add(c, total * 1000 / sr, 0);
+
+    return music_seek_collect_done(c, s);
+}
+
+//WAV按字节率直接算，对齐到块
+static int music_seek_scan_wav(struct music_seek_builder *b, struct music_seek_slot *s)
+{
+    u8 h[16];
+    u32 off = 12, len, byte_rate = 0, align = 0, data = 0, data_len = 0, ms;
+    int err;
+
+    if ((err = music_seek_reader_peek(b, 0, h, 12))) {
+        return err;
+    }
+    if (memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4)) {
+        return SEEK_NONE;
+    }
+    while (!(err = music_seek_reader_peek(b, off, h, 8))) {
+        len = music_seek_le32(h + 4);
+        if (!memcmp(h, "data", 4)) {
+            //边录边写的文件data长度可能没填，按文件长度算
+            data = off + 8;
+            data_len = MIN(len, b->rd.file_len - data);
+            break;
+        }
+        if (len >= b->rd.file_len) {
+            break;
+        }
+        if (!memcmp(h, "fmt ", 4) && !music_seek_reader_peek(b, off + 8, h, 16)) {
+            byte_rate = music_seek_le32(h + 8);
+            align = h[12] | (h[13] << 8);
+        }
+        off += 8 + len + (len & 1);
+    }
+    if (err == SEEK_NONE) {
+        return SEEK_NONE;
+    }
+    //有RIFF头却块长度越界或data前没有可用的fmt，结构自相矛盾
+    if (!data || !byte_rate || !align) {
+        return SEEK_BAD;
+    }
+
+    ms = (u64)data_len * 1000 / byte_rate;
+    s->hdr_len = data;
+    s->step_ms = MAX(MUSIC_SEEK_FINE_MS, (ms + MUSIC_SEEK_POINTS - 1) / MUSIC_SEEK_POINTS);
+    s->count = MIN(MUSIC_SEEK_POINTS, ms / s->step_ms + 1);
+    for (int k = 0; k < s->count; k++) {
+        s->point[k] = data + (u32)((u64)k * s->step_ms * byte_rate / 1000 / align * align);
+    }
+    return 0;
+}
+
+//扫一首生成跳转表，不支持的格式count为0
+static int music_seek_build_slot(struct music_seek_builder *b, const struct music_index_entry *e,
+                                 struct music_seek_slot *s)
+{
+    char path[MUSIC_INDEX_PATH_MAX + 32];
+    int root_len = strlen(b->root);
+    int err = SEEK_NONE;
+
+    memset(s, 0, sizeof(*s));
+    s->sclust = e->sclust;
+    s->size = e->size;
+    s->format = e->format;
+
+    memset(path, 0, sizeof(path));
+    memcpy(path, b->root, root_len);
+    memcpy(path + root_len, e->path, MIN(e->path_len, sizeof(path) - root_len - 1));
+    b->rd.file = fopen(path, "r");
+    if (b->rd.file) {
+        b->rd.file_len = flen(b->rd.file);
+        b->rd.base = 0;
+        b->rd.len = 0;
+        switch (e->format) {
+        case MUSIC_FMT_MP3:
+            err = music_seek_scan_frames(b, s, music_seek_mp3_frame);
+            break;
+        case MUSIC_FMT_AAC:
+            err = music_seek_scan_frames(b, s, music_seek_adts_frame);
+            break;
+        case MUSIC_FMT_FLAC:
+            err = music_seek_scan_flac(b, s);
+            break;
+        case MUSIC_FMT_WAV:
+            err = music_seek_scan_wav(b, s);
+            break;
+        default:
+            //M4A的解码器按moov里的绝对偏移取样本，不能从中间接着读
+            break;
+        }
+        fclose(b->rd.file);
+        b->rd.file = NULL;
+    }
+    if (err) {
+        s->count = 0;
+        s->hdr_len = 0;
+        s->step_ms = 0;
+        s->bad = err == SEEK_BAD;
+    }
+    s->crc = music_seek_slot_crc(s);
+    log_info("build %s: fmt %d, %d points step %dms, err %d", path, s->format, s->count, s->step_ms, err);
+
+    return err;
+}
+
+static void music_seek_task(void *priv)
+{
+    struct music_seek_builder *b = (struct music_seek_builder *)priv;
+    struct music_index_entry e;
+    struct music_seek_slot slot;
+    u32 t = timer_get_ms();
+    int built = 0;
+    int bad = 0;
+    int err;
+
+    for (int i = 0; i < b->ix->hdr.track_count && !b->exit; i++) {
+        if (music_index_read(b->ix, i, &e)) {
+            continue;
+        }
+        os_mutex_pend(&seek_mutex, 0);
+        if (!music_seek_read_slot(b->fp, i, &slot) && slot.sclust == e.sclust && slot.size == e.size) {
+            os_mutex_post(&seek_mutex);
+            //索引重建过坏文件标记会丢，按表里的结论补回去
+            if (slot.bad && !music_index_is_bad(b->ix, i)) {
+                music_index_set_bad(b->ix, i);
+            }
+            continue;
+        }
+        os_mutex_post(&seek_mutex);
+
+        err = music_seek_build_slot(b, &e, &slot);
+        if (b->exit) {
+            break;
+        }
+        if (err == SEEK_BAD) {
+            music_index_set_bad(b->ix, i);
+            bad++;
+        }
+        os_mutex_pend(&seek_mutex, 0);
+        fseek(b->fp, i * SLOT_SIZE, SEEK_SET);
+        fwrite(&slot, SLOT_SIZE, 1, b->fp);
+        fflush(b->fp);
+        os_mutex_post(&seek_mutex);
+        built++;
+        os_time_dly(MUSIC_SEEK_IDLE_TICKS);
+    }
+    if (built) {
+        log_i("music seek table: %d tracks built, %d bad, %dms\n", built, bad, timer_get_ms() - t);
+    }
+
+    //扫完等music_seek_stop收尾
+    os_sem_pend(&b->sem, 0);
+}
+
+//旧表和新索引的顺序基本一致，从上次匹配的位置往后找一小段同一文件(起始簇+大小)的表
+static int music_seek_reuse(FILE *old_fp, int old_count, int *old_pos, const struct music_index_entry *e,
+                            struct music_seek_slot *s)
+{
+    for (int k = *old_pos; k < old_count && k < *old_pos + MUSIC_INDEX_REUSE_WIN; k++) {
+        if (music_seek_read_slot(old_fp, k, s)) {
+            continue;
+        }
+        if (s->sclust == e->sclust && s->size == e->size) {
+            *old_pos = k + 1;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+//建索引时调用：按新索引的曲目数另写一份表，同一文件的旧表(含坏文件结论)挪到新序号，
+//其余清零由后台重新扫；写完删旧表再改名
+int music_seek_prealloc(struct music_index *ix)
+{
+    struct music_seek_slot *slot;
+    struct music_index_entry e;
+    char path[64];
+    FILE *fp, *old_fp;
+    int old_count = 0, old_pos = 0;
+    int reused = 0;
+    int err = 0;
+
+    slot = malloc(SLOT_SIZE);
+    if (!slot) {
+        return -1;
+    }
+    if (!seek_mutex_init) {
+        os_mutex_create(&seek_mutex);
+        seek_mutex_init = 1;
+    }
+    music_seek_path(path, sizeof(path), ix->root);
+    old_fp = fopen(path, "r");
+    if (old_fp) {
+        old_count = flen(old_fp) / SLOT_SIZE;
+    }
+    snprintf(path, sizeof(path), "%s%s", ix->root, MUSIC_SEEK_TMP);
+    fp = fopen(path, "w+");
+    if (!fp) {
+        err = -1;
+        goto __exit;
+    }
+    for (int i = 0; i < ix->hdr.track_count; i++) {
+        if (old_fp && !music_index_read(ix, i, &e) && !music_seek_reuse(old_fp, old_count, &old_pos, &e, slot)) {
+            reused++;
+        } else {
+            memset(slot, 0, SLOT_SIZE);
+        }
+        if (fwrite(slot, SLOT_SIZE, 1, fp) != SLOT_SIZE) {
+            err = -1;
+            break;
+        }
+    }
+    if (err) {
+        fdelete(fp);
+        goto __exit;
+    }
+
+    //查表的一方按文件名打开，换文件时拿着锁
+    music_seek_path(path, sizeof(path), ix->root);
+    os_mutex_pend(&seek_mutex, 0);
+    if (old_fp) {
+        fdelete(old_fp);
+        old_fp = NULL;
+    }
+    err = frename(fp, path);
+    os_mutex_post(&seek_mutex);
+    fclose(fp);
+    log_info("prealloc %d slots, reuse %d", ix->hdr.track_count, reused);
+
+__exit:
+    if (old_fp) {
+        fclose(old_fp);
+    }
+    free(slot);
+    return err;
+}
+
+//索引就绪后启动后台扫描，已有表的曲目跳过；ix要在music_seek_stop之后才能关
+int music_seek_start(struct music_index *ix)
+{
+    struct music_seek_builder *b;
+    char path[64];
+
+    music_seek_stop();
+    if (!ix->fp || ix->builder) {
+        return -1;
+    }
+
+    if (!seek_mutex_init) {
+        os_mutex_create(&seek_mutex);
+        seek_mutex_init = 1;
+    }
+    b = zalloc(sizeof(*b));
+    if (!b) {
+        return -1;
+    }
+    b->root = ix->root;
+    b->ix = ix;
+    music_seek_path(path, sizeof(path), b->root);
+    b->fp = fopen(path, "r+");
+    if (!b->fp || flen(b->fp) < ix->hdr.track_count * SLOT_SIZE) {
+        //表文件被删过，等下次重建索引时一起建
+        goto __err;
+    }
+    os_sem_create(&b->sem, 0);
+    if (thread_fork("music_seek", MUSIC_SEEK_TASK_PRIO, MUSIC_SEEK_TASK_STK, 0,
+                    &b->pid, music_seek_task, b)) {
+        os_sem_del(&b->sem, OS_DEL_ALWAYS);
+        goto __err;
+    }
+    seek_builder = b;
+
+    return 0;
+
+__err:
+    if (b->fp) {
+        fclose(b->fp);
+    }
+    free(b);
+    return -1;
+}
+
+//换卡/拔卡前停掉，正在扫的那首放弃
+void music_seek_stop(void)
+{
+    struct music_seek_builder *b = seek_builder;
+
+    if (!b) {
+        return;
+    }
+    seek_builder = NULL;
+    b->exit = 1;
+    os_sem_post(&b->sem);
+    thread_kill(&b->pid, KILL_WAIT);
+    os_sem_del(&b->sem, OS_DEL_ALWAYS);
+    if (b->rd.file) {
+        fclose(b->rd.file);
+    }
+    fclose(b->fp);
+    free(b);
+}
+
+//查第track首time_ms处的偏移，表还没扫到或格式不支持返回-1
+int music_seek_lookup(const char *root, int track, u32 sclust, u32 size, u32 time_ms, struct music_seek_pos *pos)
+{
+    struct music_seek_slot slot;
+    char path[64];
+    FILE *fp;
+    int err = -1;
+    int k;
+
+    if (!seek_mutex_init) {
+        return -1;
+    }
+    music_seek_path(path, sizeof(path), root);
+    os_mutex_pend(&seek_mutex, 0);
+    fp = fopen(path, "r");
+    if (fp) {
+        err = music_seek_read_slot(fp, track, &slot);
+        fclose(fp);
+    }
+    os_mutex_post(&seek_mutex);
+
+    if (err || slot.sclust != sclust || slot.size != size || !slot.count) {
+        return -1;
+    }
+    k = MIN(time_ms / slot.step_ms, slot.count - 1);
+    pos->hdr_len = slot.hdr_len;
+    pos->offset = slot.point[k];
+    pos->time_ms = k * slot.step_ms;
+    log_info("lookup track %d %dms: point %d offset %d", track, time_ms, k, pos->offset);
+
+    return 0;
+}
+
+#endif
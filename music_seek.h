@@ -0,0 +1,56 @@
+/*
+@file: music_seek.h
+@brief: 本地音乐跳转表，按时间直接查到文件偏移
+@date: 2026/10/19
+*/
+#ifndef _MUSIC_SEEK_H_
+#define _MUSIC_SEEK_H_
+
+#include "os/os_api.h"
+#include "app_config.h"
+#include "fs/fs.h"
+
+#define MUSIC_SEEK_ENABLE       // 跳转表开关，需要媒体库索引；扫描时顺便检查文件头，坏文件记进索引
+
+#ifdef MUSIC_SEEK_ENABLE
+
+#define MUSIC_SEEK_FILE         "MUSIC.SIX"     // 放在卷根目录，第n首的跳转表在n*256处
+#define MUSIC_SEEK_TMP          "MUSIC.SIT"     // 重建索引时先写临时文件，写完再改名
+#define MUSIC_SEEK_POINTS       58              // 每首的时间点数，按时长均分
+#define MUSIC_SEEK_FINE_MS      1000            // 扫描时先按1秒记点，超出再对半合并
+#define MUSIC_SEEK_FINE_MAX     1024
+#define MUSIC_SEEK_SYNC_MAX     (64 * 1024)     // 文件头后找第一帧的范围
+#define MUSIC_SEEK_BUF_SIZE     2048
+#define MUSIC_SEEK_TASK_PRIO    3               // 后台扫描优先级，低于预读缓存
+#define MUSIC_SEEK_TASK_STK     1024
+#define MUSIC_SEEK_IDLE_TICKS   5               // 每扫完一首让出的时间
+
+//定长256字节，count为0表示这首不支持跳转(格式不支持或解析失败)，免得每次插卡都重扫
+struct music_seek_slot {
+    u32 sclust;                     // 和size一起确认表还是这个文件的
+    u32 size;
+    u32 step_ms;                    // 相邻两点的时间间隔
+    u32 hdr_len;                    // 解码器要的文件头长度，跳转后仍从[0, hdr_len)读
+    u16 count;
+    u8  format;
+    u8  bad;                        // 文件头校验不过
+    u32 point[MUSIC_SEEK_POINTS];   // 第k点：k*step_ms时刻所在帧的文件偏移
+    u32 crc;
+};
+
+struct music_seek_pos {
+    u32 hdr_len;
+    u32 offset;                     // 文件头之后直接接着读这里
+    u32 time_ms;                    // offset处的实际时间，不晚于要跳的时间
+};
+
+struct music_index;
+
+int music_seek_prealloc(struct music_index *ix);
+int music_seek_start(struct music_index *ix);
+void music_seek_stop(void);
+int music_seek_lookup(const char *root, int track, u32 sclust, u32 size, u32 time_ms, struct music_seek_pos *pos);
+
+#endif
+
+#endif
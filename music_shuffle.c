@@ -0,0 +1,199 @@
+/*
+@file: music_shuffle.c
+@brief: 本地音乐随机播放顺序
+        按种子对播放范围内的曲目序号做一次Fisher-Yates洗牌，一轮内每首只播一次；
+        上一首/下一首只是在顺序表里前后移一格，下一首提前就能知道，可以预开；
+        一轮播完换下一个种子再洗一轮，新一轮第一首避开刚播完的那首；
+        一轮最后一首时要预开下一首，下一轮另外洗好放着，这一轮的顺序到真正换轮时才替换
+@date: 2026/10/19
+*/
+
+#include "os/os_api.h"
+#include "app_config.h"
+#include "music_shuffle.h"
+
+#ifdef MUSIC_SHUFFLE_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[MUSIC_SHUFFLE]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+static u32 music_shuffle_rand(u32 *seed)
+{
+    u32 x = *seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+
+    return x;
+}
+
+//按seed洗牌，再把anchor换到第一个
+static void music_shuffle_fill(struct music_shuffle *sh, u16 *order, u32 seed, int anchor)
+{
+    u32 rnd = seed;
+    u16 t;
+    int j;
+
+    for (int i = 0; i < sh->count; i++) {
+        order[i] = sh->first + i;
+    }
+    for (int i = sh->count - 1; i > 0; i--) {
+        j = music_shuffle_rand(&rnd) % (i + 1);
+        t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    if (anchor < sh->first || anchor >= sh->first + sh->count) {
+        return;
+    }
+    for (int i = 0; i < sh->count; i++) {
+        if (order[i] == anchor) {
+            order[i] = order[0];
+            order[0] = anchor;
+            break;
+        }
+    }
+}
+
+//换下一个种子洗下一轮放进order，第一首撞上last就用第二首打头
+static void music_shuffle_deal(struct music_shuffle *sh, u16 *order, int last)
+{
+    sh->next_seed = sh->seed;
+    music_shuffle_rand(&sh->next_seed);
+    sh->next_anchor = -1;
+    music_shuffle_fill(sh, order, sh->next_seed, -1);
+    if (sh->count > 1 && order[0] == last) {
+        sh->next_anchor = order[1];
+        order[1] = order[0];
+        order[0] = sh->next_anchor;
+    }
+}
+
+//提前洗好下一轮，当前这一轮不动
+static int music_shuffle_prepare(struct music_shuffle *sh)
+{
+    if (sh->next_order) {
+        return 0;
+    }
+    sh->next_order = (u16 *)malloc(sh->count * sizeof(u16));
+    if (!sh->next_order) {
+        return -1;
+    }
+    music_shuffle_deal(sh, sh->next_order, sh->pos >= 0 ? sh->order[sh->pos] : -1);
+
+    return 0;
+}
+
+//一轮播完换成下一轮，提前洗好的直接换上，没有的原地重洗
+static void music_shuffle_round(struct music_shuffle *sh)
+{
+    if (sh->next_order) {
+        free(sh->order);
+        sh->order = sh->next_order;
+        sh->next_order = NULL;
+    } else {
+        music_shuffle_deal(sh, sh->order, sh->pos >= 0 ? sh->order[sh->pos] : -1);
+    }
+    sh->seed = sh->next_seed;
+    sh->anchor = sh->next_anchor;
+    sh->pos = -1;
+    log_info("new round seed %x", sh->seed);
+}
+
+//anchor为当前曲目时它算这一轮已经播过
+int music_shuffle_init(struct music_shuffle *sh, int first, int count, u32 seed, int anchor)
+{
+    music_shuffle_free(sh);
+    if (count <= 0) {
+        return -1;
+    }
+    sh->order = (u16 *)malloc(count * sizeof(u16));
+    if (!sh->order) {
+        return -1;
+    }
+    sh->seed = seed ? seed : 1;
+    sh->first = first;
+    sh->count = count;
+    sh->anchor = anchor;
+    music_shuffle_fill(sh, sh->order, sh->seed, anchor);
+    sh->pos = sh->order[0] == anchor ? 0 : -1;
+
+    return 0;
+}
+
+void music_shuffle_free(struct music_shuffle *sh)
+{
+    if (sh->order) {
+        free(sh->order);
+    }
+    if (sh->next_order) {
+        free(sh->next_order);
+    }
+    memset(sh, 0, sizeof(*sh));
+}
+
+int music_shuffle_next(struct music_shuffle *sh)
+{
+    if (!sh->order) {
+        return -1;
+    }
+    if (sh->pos + 1 >= sh->count) {
+        music_shuffle_round(sh);
+    }
+    return sh->order[++sh->pos];
+}
+
+//回到这一轮里的上一首，已经是这一轮第一首时返回-1
+int music_shuffle_prev(struct music_shuffle *sh)
+{
+    if (!sh->order || sh->pos <= 0) {
+        return -1;
+    }
+    return sh->order[--sh->pos];
+}
+
+//下一首是谁但不移过去，正好是一轮最后一首时另外洗好下一轮，这一轮还能往回退
+int music_shuffle_peek(struct music_shuffle *sh)
+{
+    if (!sh->order) {
+        return -1;
+    }
+    if (sh->pos + 1 < sh->count) {
+        return sh->order[sh->pos + 1];
+    }
+    if (music_shuffle_prepare(sh)) {
+        return -1;
+    }
+    return sh->next_order[0];
+}
+
+//开机恢复位置：记录的位置上还是这首就直接用，否则找一遍
+int music_shuffle_locate(struct music_shuffle *sh, int pos, int track)
+{
+    if (!sh->order) {
+        return -1;
+    }
+    //提前洗好的下一轮避开的是原来的最后一首，位置变了重新洗
+    if (sh->next_order) {
+        free(sh->next_order);
+        sh->next_order = NULL;
+    }
+    if (pos >= 0 && pos < sh->count && sh->order[pos] == track) {
+        sh->pos = pos;
+        return 0;
+    }
+    for (int i = 0; i < sh->count; i++) {
+        if (sh->order[i] == track) {
+            sh->pos = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+#endif
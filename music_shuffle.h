@@ -0,0 +1,38 @@
+/*
+@file: music_shuffle.h
+@brief: 本地音乐随机播放顺序
+@date: 2026/10/19
+*/
+#ifndef _MUSIC_SHUFFLE_H_
+#define _MUSIC_SHUFFLE_H_
+
+#include "os/os_api.h"
+#include "app_config.h"
+
+#define MUSIC_SHUFFLE_ENABLE    // 随机播放开关
+
+#ifdef MUSIC_SHUFFLE_ENABLE
+
+//顺序由seed和anchor完全确定，断电只需记这几个数，开机重新生成同一个顺序
+struct music_shuffle {
+    u16 *order;                     // 一轮的播放顺序，存的是曲目序号
+    u32 seed;
+    int first;                      // 随机范围[first, first+count)
+    int count;
+    int anchor;                     // 排到第一个的曲目，-1不指定
+    int pos;                        // 当前曲目在order里的位置，-1还没开始
+    u16 *next_order;                // 播到一轮最后一首时提前洗好的下一轮，这一轮的顺序仍保留
+    u32 next_seed;
+    int next_anchor;
+};
+
+int music_shuffle_init(struct music_shuffle *sh, int first, int count, u32 seed, int anchor);
+void music_shuffle_free(struct music_shuffle *sh);
+int music_shuffle_next(struct music_shuffle *sh);
+int music_shuffle_prev(struct music_shuffle *sh);
+int music_shuffle_peek(struct music_shuffle *sh);
+int music_shuffle_locate(struct music_shuffle *sh, int pos, int track);
+
+#endif
+
+#endif
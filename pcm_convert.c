@@ -0,0 +1,75 @@
+/*
+@file: pcm_convert.c
+@brief: 16位PCM和内部浮点之间的转换
+        四路展开，编译器可以按平台向量化；
+        转回16位时加高通TPDF抖动(相邻两个均匀随机数相减，幅度±1LSB)，再饱和取整
+@date: 2026/10/19
+*/
+
+#include "app_config.h"
+#include "pcm_convert.h"
+
+#ifdef PCM_DITHER_ENABLE
+static u32 dither_seed = 22222;
+static s32 dither_last;
+#endif
+
+//按步长从交织数据里取一个通道
+void pcm_s16_to_float(const s16 *in, int stride, float *out, int n)
+{
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        out[i]     = in[0];
+        out[i + 1] = in[stride];
+        out[i + 2] = in[stride * 2];
+        out[i + 3] = in[stride * 3];
+        in += stride * 4;
+    }
+    for (; i < n; i++) {
+        out[i] = *in;
+        in += stride;
+    }
+}
+
+static inline s16 pcm_sat_round(float x)
+{
+    if (x > 32767.0f) {
+        x = 32767.0f;
+    } else if (x < -32768.0f) {
+        x = -32768.0f;
+    }
+    //偏移成正数后截断就是四舍五入
+    return (s16)((s32)(x + 32768.5f) - 32768);
+}
+
+#ifdef PCM_DITHER_ENABLE
+static inline float pcm_dither(void)
+{
+    s32 r;
+    float d;
+
+    dither_seed = dither_seed * 1664525 + 1013904223;
+    r = dither_seed >> 16;
+    d = (r - dither_last) * (1.0f / 65536);
+    dither_last = r;
+    return d;
+}
+#else
+#define pcm_dither()    0
+#endif
+
+void pcm_float_to_s16(const float *in, s16 *out, int n)
+{
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        out[i]     = pcm_sat_round(in[i] + pcm_dither());
+        out[i + 1] = pcm_sat_round(in[i + 1] + pcm_dither());
+        out[i + 2] = pcm_sat_round(in[i + 2] + pcm_dither());
+        out[i + 3] = pcm_sat_round(in[i + 3] + pcm_dither());
+    }
+    for (; i < n; i++) {
+        out[i] = pcm_sat_round(in[i] + pcm_dither());
+    }
+}
@@ -0,0 +1,18 @@
+/*
+@file: pcm_convert.h
+@brief: 16位PCM和内部浮点之间的转换
+@date: 2026/10/19
+*/
+#ifndef _PCM_CONVERT_H_
+#define _PCM_CONVERT_H_
+
+#include "app_config.h"
+
+#define PCM_DITHER_ENABLE       // 转回16位时加TPDF抖动
+
+//内部浮点样本幅度仍按16位满量程计(±32768)，各级之间不限幅，
+//只在采集入口和DAC出口各转换一次
+void pcm_s16_to_float(const s16 *in, int stride, float *out, int n);
+void pcm_float_to_s16(const float *in, s16 *out, int n);
+
+#endif
@@ -0,0 +1,297 @@
+/*
+@file: rec_adpcm.c
+@brief: IMA-ADPCM(4:1) WAV录音
+        不开编码服务器，后台任务直接从预录环形缓冲按块取PCM，
+        查表编码成标准IMA-ADPCM块(WAVE格式0x11)，攒够几块整块写卡；
+        文件头的长度字段定期和关闭时回写，掉电只丢最后一个检查点之后的数据
+@date: 2026/10/19
+*/
+
+#include <time.h>
+#include "os/os_api.h"
+#include "app_config.h"
+#include "fs/fs.h"
+#include "rec_adpcm.h"
+#include "rec_catalog.h"
+
+#ifdef REC_ADPCM_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[REC_ADPCM]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+static const s8 ima_index_table[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+static const u16 ima_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static inline void put_le16(u8 *p, u16 v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static inline void put_le32(u8 *p, u32 v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+//按标准解码器的重建方式编码一个样本，预测值和解码端保持一致
+static inline u8 ima_adpcm_encode_sample(struct ima_adpcm_state *st, s16 sample)
+{
+    int step = ima_step_table[st->index];
+    int diff = sample - st->predictor;
+    int vpdiff = step >> 3;
+    int pred = st->predictor;
+    int index;
+    u8 code = 0;
+
+    if (diff < 0) {
+        code = 8;
+        diff = -diff;
+    }
+    if (diff >= step) {
+        code |= 4;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 2;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 1;
+        vpdiff += step;
+    }
+
+    pred += (code & 8) ? -vpdiff : vpdiff;
+    if (pred > 32767) {
+        pred = 32767;
+    } else if (pred < -32768) {
+        pred = -32768;
+    }
+    st->predictor = pred;
+
+    index = st->index + ima_index_table[code];
+    if (index < 0) {
+        index = 0;
+    } else if (index > 88) {
+        index = 88;
+    }
+    st->index = index;
+
+    return code;
+}
+
+//编码一块交织PCM，返回块字节数
+//块头每声道4字节(首样本+步长索引)，之后每声道8个样本一组4字节交织，低半字节在前
+int ima_adpcm_encode_block(struct ima_adpcm_state *st, const s16 *pcm, u8 channel, int samples_per_block, u8 *out)
+{
+    u8 *p = out;
+
+    for (int ch = 0; ch < channel; ch++) {
+        st[ch].predictor = pcm[ch];
+        put_le16(p, st[ch].predictor);
+        p[2] = st[ch].index;
+        p[3] = 0;
+        p += 4;
+    }
+    for (int i = 1; i < samples_per_block; i += 8) {
+        for (int ch = 0; ch < channel; ch++) {
+            const s16 *s = pcm + i * channel + ch;
+            for (int k = 0; k < 8; k += 2) {
+                u8 lo = ima_adpcm_encode_sample(&st[ch], s[k * channel]);
+                u8 hi = ima_adpcm_encode_sample(&st[ch], s[(k + 1) * channel]);
+                *p++ = lo | (hi << 4);
+            }
+        }
+    }
+
+    return p - out;
+}
+
+//写文件头后回到数据末尾
+static int rec_adpcm_write_header(struct rec_adpcm *ad)
+{
+    u8 h[REC_ADPCM_HDR_SIZE];
+    int ret;
+
+    memcpy(h, "RIFF", 4);
+    put_le32(h + 4, REC_ADPCM_HDR_SIZE - 8 + ad->data_len);
+    memcpy(h + 8, "WAVE", 4);
+    memcpy(h + 12, "fmt ", 4);
+    put_le32(h + 16, 20);
+    put_le16(h + 20, WAVE_FORMAT_IMA_ADPCM);
+    put_le16(h + 22, ad->channel);
+    put_le32(h + 24, ad->sample_rate);
+    put_le32(h + 28, ad->sample_rate * ad->block_align / ad->samples_per_block);
+    put_le16(h + 32, ad->block_align);
+    put_le16(h + 34, 4);
+    put_le16(h + 36, 2);
+    put_le16(h + 38, ad->samples_per_block);
+    memcpy(h + 40, "fact", 4);
+    put_le32(h + 44, 4);
+    put_le32(h + 48, ad->samples);
+    memcpy(h + 52, "data", 4);
+    put_le32(h + 56, ad->data_len);
+
+    fseek(ad->fp, 0, SEEK_SET);
+    ret = fwrite(h, sizeof(h), 1, ad->fp);
+    fseek(ad->fp, REC_ADPCM_HDR_SIZE + ad->data_len, SEEK_SET);
+
+    return ret == sizeof(h) ? 0 : -1;
+}
+
+static int rec_adpcm_flush(struct rec_adpcm *ad)
+{
+    if (!ad->out_len) {
+        return 0;
+    }
+    if (fwrite(ad->out, ad->out_len, 1, ad->fp) != ad->out_len) {
+        return -1;
+    }
+    ad->data_len += ad->out_len;
+    ad->out_len = 0;
+    return 0;
+}
+
+//取PCM编码写卡，输入返回0(停止录音)后退出
+static void rec_adpcm_task(void *priv)
+{
+    struct rec_adpcm *ad = (struct rec_adpcm *)priv;
+    u32 len = ad->samples_per_block * ad->channel * 2;
+
+    while (ad->read_input((u8 *)ad->pcm, len) == len) {
+        ad->out_len += ima_adpcm_encode_block(ad->st, ad->pcm, ad->channel,
+                                              ad->samples_per_block, ad->out + ad->out_len);
+        ad->samples += ad->samples_per_block;
+
+        if (ad->out_len >= ad->block_align * REC_ADPCM_FLUSH_BLOCKS) {
+            if (rec_adpcm_flush(ad)) {
+                log_e("rec adpcm write err\n");
+                ad->err = 1;
+                break;
+            }
+            if (ad->samples - ad->last_checkpoint >= ad->sample_rate * REC_ADPCM_CHECKPOINT_SEC) {
+                ad->last_checkpoint = ad->samples;
+                rec_adpcm_write_header(ad);
+                fflush(ad->fp);
+            }
+        }
+    }
+}
+
+struct rec_adpcm *rec_adpcm_open(const char *path, int sample_rate, u8 channel, rec_adpcm_input_t read_input)
+{
+    struct rec_adpcm *ad;
+    int path_len = file_path_len(path);
+
+    if (channel < 1 || channel > 2 || path_len >= REC_PATH_MAX - 2) {
+        return NULL;
+    }
+    ad = zalloc(sizeof(*ad));
+    if (!ad) {
+        return NULL;
+    }
+    memcpy(ad->path, path, path_len);
+    ad->sample_rate = sample_rate;
+    ad->channel = channel;
+    ad->block_align = REC_ADPCM_BLOCK_SIZE * channel;
+    ad->samples_per_block = (REC_ADPCM_BLOCK_SIZE - 4) * 2 + 1;
+    ad->read_input = read_input;
+    ad->start_time = time(NULL);
+
+    ad->pcm = malloc(ad->samples_per_block * channel * 2);
+    ad->out = malloc(ad->block_align * REC_ADPCM_FLUSH_BLOCKS);
+    if (!ad->pcm || !ad->out) {
+        goto __err;
+    }
+
+    ad->fp = fopen(path, "w+");
+    if (!ad->fp) {
+        goto __err;
+    }
+    if (rec_adpcm_write_header(ad)) {
+        fclose(ad->fp);
+        goto __err;
+    }
+
+    if (thread_fork("rec_adpcm", REC_ADPCM_TASK_PRIO, REC_ADPCM_TASK_STK, 0,
+                    &ad->pid, rec_adpcm_task, ad)) {
+        fdelete(ad->fp);
+        goto __err;
+    }
+    log_info("open: %dHz %dch block %d", sample_rate, channel, ad->block_align);
+
+    return ad;
+
+__err:
+    if (ad->pcm) {
+        free(ad->pcm);
+    }
+    if (ad->out) {
+        free(ad->out);
+    }
+    free(ad);
+    return NULL;
+}
+
+//调用前先让输入返回0，任务取完最后一块自行退出
+int rec_adpcm_close(struct rec_adpcm *ad)
+{
+    int err;
+
+    if (!ad) {
+        return 0;
+    }
+    thread_kill(&ad->pid, KILL_WAIT);
+
+    err = ad->err ? -1 : rec_adpcm_flush(ad);
+    if (rec_adpcm_write_header(ad)) {
+        err = -1;
+    }
+    fclose(ad->fp);
+    log_info("close: %d samples, %d bytes", ad->samples, ad->data_len);
+
+#ifdef REC_CATALOG_ENABLE
+    if (!err) {
+        struct rec_container_hdr hdr = {0};
+        hdr.sample_rate = ad->sample_rate;
+        hdr.channel = ad->channel;
+        strncpy(hdr.format, REC_ADPCM_FORMAT, sizeof(hdr.format) - 1);
+        hdr.data_end = REC_ADPCM_HDR_SIZE + ad->data_len;
+        hdr.start_time = ad->start_time;
+        hdr.duration_ms = (u64)ad->samples * 1000 / ad->sample_rate;
+        hdr.flags = REC_FLAG_FINALIZED;
+        rec_catalog_add(ad->path, &hdr, NULL);
+    }
+#endif
+
+    free(ad->pcm);
+    free(ad->out);
+    free(ad);
+
+    return err;
+}
+
+#endif
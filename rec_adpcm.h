@@ -0,0 +1,62 @@
+/*
+@file: rec_adpcm.h
+@brief: IMA-ADPCM(4:1) WAV录音，不经过编码服务器
+@date: 2026/10/19
+*/
+#ifndef _REC_ADPCM_H_
+#define _REC_ADPCM_H_
+
+#include "os/os_api.h"
+#include "fs/fs.h"
+#include "rec_container.h"
+
+#define REC_ADPCM_ENABLE        // ADPCM录音开关
+
+#ifdef REC_ADPCM_ENABLE
+
+#define REC_ADPCM_FORMAT        "adpcm" // CONFIG_AUDIO_RECORDER_SAVE_FORMAT取此值时走ADPCM
+#define REC_ADPCM_EXT           "wav"
+#define REC_ADPCM_BLOCK_SIZE    256     // 每声道每块字节数，单声道一块505个样本
+#define REC_ADPCM_FLUSH_BLOCKS  16      // 攒够多少块写一次卡
+#define REC_ADPCM_CHECKPOINT_SEC 5      // 文件头长度字段更新间隔，掉电后按此前的长度播放
+#define REC_ADPCM_TASK_PRIO     6       // 编码写卡任务优先级，低于采集
+#define REC_ADPCM_TASK_STK      1024
+
+#define WAVE_FORMAT_IMA_ADPCM   0x0011
+#define REC_ADPCM_HDR_SIZE      60      // RIFF+fmt(20)+fact+data头
+
+//从采集通路取PCM，凑够len返回len，停止录音时返回0
+typedef u32 (*rec_adpcm_input_t)(u8 *buf, u32 len);
+
+struct ima_adpcm_state {
+    s16 predictor;
+    u8 index;
+};
+
+struct rec_adpcm {
+    FILE *fp;
+    char path[REC_PATH_MAX];
+    int sample_rate;
+    u8 channel;
+    u16 block_align;
+    u16 samples_per_block;
+    struct ima_adpcm_state st[2];
+    rec_adpcm_input_t read_input;
+    s16 *pcm;                   // 一块的交织PCM
+    u8 *out;                    // 待写卡的编码块
+    u32 out_len;
+    u32 data_len;               // 已写入的data长度
+    u32 samples;                // 已编码的每声道样本数
+    u32 start_time;
+    u32 last_checkpoint;        // 上次更新文件头时的样本数
+    volatile u8 err;
+    int pid;
+};
+
+struct rec_adpcm *rec_adpcm_open(const char *path, int sample_rate, u8 channel, rec_adpcm_input_t read_input);
+int rec_adpcm_close(struct rec_adpcm *ad);
+int ima_adpcm_encode_block(struct ima_adpcm_state *st, const s16 *pcm, u8 channel, int samples_per_block, u8 *out);
+
+#endif
+
+#endif
@@ -0,0 +1,108 @@
+/*
+@file: rec_arena.c
+@brief: 录音会话内存池
+        一次会话(进录音模式到recorder_close)里的缓冲都从这里顺序分配，关闭时整体释放；
+        优先用常驻静态池，长期反复切模式也不会把堆切碎
+@date: 2026/10/19
+*/
+
+#include "app_config.h"
+#include "rec_arena.h"
+
+#ifdef REC_ARENA_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[REC_ARENA]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+static u8 arena_pool[REC_ARENA_SIZE] __attribute__((aligned(REC_ARENA_ALIGN)));
+static struct rec_arena arena_hdl;
+
+#define __this (&arena_hdl)
+
+#define ARENA_ALIGN(x)  (((x) + REC_ARENA_ALIGN - 1) & ~(REC_ARENA_ALIGN - 1))
+
+//按会话参数算出需要的总大小，和recorder_play_to_dac里的分配一一对应
+u32 rec_arena_calc_size(int sample_rate, u8 channel, u32 features)
+{
+    u32 size = 0;
+
+    if (channel > 2) {
+        channel = 2;
+    }
+    if (features & REC_ARENA_F_MONITOR) {
+        size += ARENA_ALIGN(sample_rate * channel);
+    }
+
+    return size;
+}
+
+int rec_arena_open(u32 size)
+{
+    if (__this->base) {
+        rec_arena_close();
+    }
+
+    size = ARENA_ALIGN(size);
+    if (size <= REC_ARENA_SIZE) {
+        __this->base = arena_pool;
+        __this->heap = 0;
+    } else {
+        //超出配置的最高采样率/声道数时才会走到这里，整块申请一次，仍在关闭时一起释放
+        log_w("rec arena %d > pool %d, use heap\n", size, REC_ARENA_SIZE);
+        __this->base = malloc(size);
+        if (!__this->base) {
+            return -1;
+        }
+        __this->heap = 1;
+    }
+    __this->size = size;
+    __this->used = 0;
+
+    log_info("open %d bytes", size);
+
+    return 0;
+}
+
+//只能顺序分配，返回的内存已清零
+void *rec_arena_alloc(u32 size)
+{
+    void *p;
+
+    size = ARENA_ALIGN(size);
+    if (!__this->base || __this->used + size > __this->size) {
+        log_e("rec arena overflow %d + %d > %d\n", __this->used, size, __this->size);
+        return NULL;
+    }
+    p = __this->base + __this->used;
+    __this->used += size;
+    if (__this->used > __this->high_water) {
+        __this->high_water = __this->used;
+    }
+    memset(p, 0, size);
+
+    return p;
+}
+
+void rec_arena_close(void)
+{
+    if (!__this->base) {
+        return;
+    }
+    log_info("close: used %d/%d high water %d", __this->used, __this->size, __this->high_water);
+    if (__this->heap) {
+        free(__this->base);
+    }
+    __this->base = NULL;
+    __this->size = 0;
+    __this->used = 0;
+}
+
+u32 rec_arena_high_water(void)
+{
+    return __this->high_water;
+}
+
+#endif
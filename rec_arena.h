@@ -0,0 +1,39 @@
+/*
+@file: rec_arena.h
+@brief: 录音会话内存池
+@date: 2026/10/19
+*/
+#ifndef _REC_ARENA_H_
+#define _REC_ARENA_H_
+
+#include "app_config.h"
+
+#define REC_ARENA_ENABLE        // 会话内存池开关
+
+#ifdef REC_ARENA_ENABLE
+
+#define REC_ARENA_MAX_RATE      48000           // 录音模式支持的最高采样率(音乐档)
+#define REC_ARENA_MAX_CHANNEL   CONFIG_AUDIO_RECORDER_CHANNEL
+//常驻静态池，按最高采样率的监听缓冲定，切到音乐档也不落到堆上
+#define REC_ARENA_SIZE          (REC_ARENA_MAX_RATE * (REC_ARENA_MAX_CHANNEL > 2 ? 2 : REC_ARENA_MAX_CHANNEL))
+#define REC_ARENA_ALIGN         8
+
+#define REC_ARENA_F_MONITOR     BIT(0)  // 采集->DAC缓冲(约0.5秒PCM)
+
+struct rec_arena {
+    u8 *base;
+    u32 size;
+    u32 used;
+    u32 high_water;         // 历次会话的最大用量
+    u8 heap;                // 1:静态池不够，整块从堆上申请
+};
+
+u32 rec_arena_calc_size(int sample_rate, u8 channel, u32 features);
+int rec_arena_open(u32 size);
+void *rec_arena_alloc(u32 size);
+void rec_arena_close(void);
+u32 rec_arena_high_water(void);
+
+#endif
+
+#endif
@@ -0,0 +1,369 @@
+/*
+@file: rec_catalog.c
+@brief: 录音文件目录索引
+        每个录音文件关闭时往索引文件末尾追加一条定长记录，列表/排序/播放最近一条
+        直接按序号读，不用全盘fscan；插卡时只扫描最后一条记录所在月份及之后的目录补齐，
+        分块容器和ADPCM WAV录音都收录
+@date: 2026/10/19
+*/
+
+#include <stddef.h>
+#include <time.h>
+#include "os/os_api.h"
+#include "app_config.h"
+#include "fs/fs.h"
+#include "rec_catalog.h"
+#include "rec_adpcm.h"
+
+#ifdef REC_CATALOG_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[REC_CAT]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+#define ENTRY_SIZE      sizeof(struct rec_catalog_entry)
+
+static OS_MUTEX cat_mutex;
+static u8 cat_mutex_init;
+
+static void rec_catalog_lock(void)
+{
+    local_irq_disable();
+    if (!cat_mutex_init) {
+        cat_mutex_init = 1;
+        local_irq_enable();
+        os_mutex_create(&cat_mutex);
+    } else {
+        local_irq_enable();
+    }
+    os_mutex_pend(&cat_mutex, 0);
+}
+
+static void rec_catalog_unlock(void)
+{
+    os_mutex_post(&cat_mutex);
+}
+
+static int rec_catalog_entry_valid(const struct rec_catalog_entry *e)
+{
+    return e->magic == REC_CATALOG_MAGIC &&
+           e->crc == file_crc32(0, e, offsetof(struct rec_catalog_entry, crc));
+}
+
+static int rec_catalog_read_at(FILE *fp, int index, struct rec_catalog_entry *e)
+{
+    fseek(fp, index * ENTRY_SIZE, SEEK_SET);
+    if (fread(e, ENTRY_SIZE, 1, fp) != ENTRY_SIZE || !rec_catalog_entry_valid(e)) {
+        return -1;
+    }
+    return 0;
+}
+
+//有效条目数，末尾写了一半的条目(掉电)不算，下次追加时覆盖掉
+static int rec_catalog_valid_count(FILE *fp)
+{
+    struct rec_catalog_entry e;
+    int n = flen(fp) / ENTRY_SIZE;
+
+    while (n > 0 && rec_catalog_read_at(fp, n - 1, &e)) {
+        n--;
+    }
+    return n;
+}
+
+int rec_catalog_add(const char *path, const struct rec_container_hdr *hdr, const u32 *seg_offset)
+{
+    struct rec_catalog_entry e = {0};
+    int root_len = strlen(CONFIG_ROOT_PATH);
+    int len = file_path_len(path);
+    int n, err = 0;
+    FILE *fp;
+
+    if (!strncmp(path, CONFIG_ROOT_PATH, root_len)) {
+        path += root_len;
+        len -= root_len;
+    }
+    if (len <= 0 || len > REC_CATALOG_PATH_MAX - 2) {
+        log_e("rec catalog path too long\n");
+        return -1;
+    }
+
+    e.magic = REC_CATALOG_MAGIC;
+    e.start_time = hdr->start_time;
+    e.duration_ms = hdr->duration_ms;
+    e.size = hdr->data_end;
+    e.sample_rate = hdr->sample_rate;
+    e.channel = hdr->channel;
+    e.segment_count = hdr->segment_count;
+    memcpy(e.format, hdr->format, sizeof(e.format));
+    if (hdr->flags & REC_FLAG_RECOVERED) {
+        e.flags |= REC_CATALOG_F_RECOVERED;
+    }
+    if (seg_offset) {
+        memcpy(e.seg_offset, seg_offset, sizeof(e.seg_offset));
+    } else {
+        e.flags |= REC_CATALOG_F_NO_SEG;
+    }
+    e.path_len = len;
+    memcpy(e.path, path, len);
+    e.crc = file_crc32(0, &e, offsetof(struct rec_catalog_entry, crc));
+
+    rec_catalog_lock();
+    fp = fopen(REC_CATALOG_FILE, "r+");
+    if (!fp) {
+        fp = fopen(REC_CATALOG_FILE, "w+");
+    }
+    if (!fp) {
+        rec_catalog_unlock();
+        return -1;
+    }
+    n = rec_catalog_valid_count(fp);
+    fseek(fp, n * ENTRY_SIZE, SEEK_SET);
+    if (fwrite(&e, ENTRY_SIZE, 1, fp) != ENTRY_SIZE) {
+        err = -1;
+    }
+    fclose(fp);
+    rec_catalog_unlock();
+
+    log_info("add %d: time %d len %d", n, e.start_time, e.size);
+
+    return err;
+}
+
+int rec_catalog_count(void)
+{
+    FILE *fp;
+    int n;
+
+    rec_catalog_lock();
+    fp = fopen(REC_CATALOG_FILE, "r");
+    if (!fp) {
+        rec_catalog_unlock();
+        return 0;
+    }
+    n = rec_catalog_valid_count(fp);
+    fclose(fp);
+    rec_catalog_unlock();
+
+    return n;
+}
+
+//按录音先后顺序，0是最早的一条
+int rec_catalog_read(int index, struct rec_catalog_entry *e)
+{
+    FILE *fp;
+    int err;
+
+    rec_catalog_lock();
+    fp = fopen(REC_CATALOG_FILE, "r");
+    if (!fp) {
+        rec_catalog_unlock();
+        return -1;
+    }
+    err = rec_catalog_read_at(fp, index, e);
+    fclose(fp);
+    rec_catalog_unlock();
+
+    return err;
+}
+
+int rec_catalog_last(struct rec_catalog_entry *e)
+{
+    FILE *fp;
+    int n;
+
+    rec_catalog_lock();
+    fp = fopen(REC_CATALOG_FILE, "r");
+    if (!fp) {
+        rec_catalog_unlock();
+        return -1;
+    }
+    n = rec_catalog_valid_count(fp);
+    if (n > 0) {
+        rec_catalog_read_at(fp, n - 1, e);
+    }
+    fclose(fp);
+    rec_catalog_unlock();
+
+    return n > 0 ? 0 : -1;
+}
+
+//拼出完整路径，可直接fopen
+int rec_catalog_get_path(const struct rec_catalog_entry *e, char *buf, int size)
+{
+    int root_len = strlen(CONFIG_ROOT_PATH);
+
+    if (root_len + e->path_len + 2 > size) {
+        return -1;
+    }
+    memset(buf, 0, size);
+    memcpy(buf, CONFIG_ROOT_PATH, root_len);
+    memcpy(buf + root_len, e->path, e->path_len);
+
+    return 0;
+}
+
+#ifdef REC_ADPCM_ENABLE
+static u32 rec_catalog_le16(const u8 *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static u32 rec_catalog_le32(const u8 *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+//ADPCM录音的WAV头换成容器头的字段；文件头不带开始时间，取文件的创建时间(和文件名一样按东八区)
+static int rec_catalog_wav_hdr(FILE *fp, struct rec_container_hdr *hdr)
+{
+    struct vfs_attr attr = {0};
+    struct tm t = {0};
+    u8 h[REC_ADPCM_HDR_SIZE];
+
+    fseek(fp, 0, SEEK_SET);
+    if (fread(h, sizeof(h), 1, fp) != sizeof(h) || memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4) || memcmp(h + 12, "fmt ", 4) ||
+        rec_catalog_le16(h + 20) != WAVE_FORMAT_IMA_ADPCM || memcmp(h + 52, "data", 4)) {
+        return -1;
+    }
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->channel = rec_catalog_le16(h + 22);
+    hdr->sample_rate = rec_catalog_le32(h + 24);
+    if (!hdr->sample_rate) {
+        return -1;
+    }
+    strncpy(hdr->format, REC_ADPCM_FORMAT, sizeof(hdr->format) - 1);
+    hdr->data_end = REC_ADPCM_HDR_SIZE + rec_catalog_le32(h + 56);
+    hdr->duration_ms = (u64)rec_catalog_le32(h + 48) * 1000 / hdr->sample_rate;
+    //文件头按检查点更新，文件比它长说明没正常关闭，按检查点的长度播放
+    hdr->flags = flen(fp) > hdr->data_end ? REC_FLAG_RECOVERED : REC_FLAG_FINALIZED;
+
+    fget_attrs(fp, &attr);
+    t.tm_year = attr.crt_time.year - 1900;
+    t.tm_mon = attr.crt_time.month - 1;
+    t.tm_mday = attr.crt_time.day;
+    t.tm_hour = attr.crt_time.hour;
+    t.tm_min = attr.crt_time.min;
+    t.tm_sec = attr.crt_time.sec;
+    hdr->start_time = mktime(&t) - 28800;
+
+    return 0;
+}
+#endif
+
+//读文件头，分块容器和ADPCM WAV统一成容器头，只收已关闭或已恢复的
+static int rec_catalog_read_hdr(FILE *fp, struct rec_container_hdr *hdr)
+{
+    if (fread(hdr, sizeof(*hdr), 1, fp) != sizeof(*hdr)) {
+        return -1;
+    }
+#ifdef REC_ADPCM_ENABLE
+    if (!memcmp(&hdr->magic, "RIFF", 4)) {
+        return rec_catalog_wav_hdr(fp, hdr);
+    }
+#endif
+    if (hdr->magic != REC_CONTAINER_MAGIC ||
+        hdr->crc != file_crc32(0, hdr, offsetof(struct rec_container_hdr, crc)) ||
+        !(hdr->flags & (REC_FLAG_FINALIZED | REC_FLAG_RECOVERED))) {
+        return -1;
+    }
+    return 0;
+}
+
+//扫描一个月份目录，把比最后一条索引新的已关闭文件补进索引
+static int rec_catalog_scan_dir(const char *dir_name, int dir_len, u32 last_time)
+{
+    struct rec_container_hdr hdr;
+    struct vfscan *fs;
+    FILE *fp;
+    char dir_path[64] = {0};
+    char path[REC_PATH_MAX];
+    char name[64];
+    int len, n = 0;
+
+    fname_to_path(dir_path, CONFIG_ROOT_PATH, dir_name, dir_len, 1, 0);
+#ifdef REC_ADPCM_ENABLE
+    fs = fscan(dir_path, "-tJRCWAV -sn", 1);
+#else
+    fs = fscan(dir_path, "-tJRC -sn", 1);
+#endif
+    if (!fs) {
+        return 0;
+    }
+
+    for (int i = 1; i <= fs->file_number; i++) {
+        fp = fselect(fs, FSEL_BY_NUMBER, i);
+        if (!fp) {
+            continue;
+        }
+        if (rec_catalog_read_hdr(fp, &hdr) || hdr.start_time <= last_time) {
+            fclose(fp);
+            continue;
+        }
+        memset(name, 0, sizeof(name));
+        len = fget_name(fp, (u8 *)name, sizeof(name) - 2);
+        fclose(fp);
+        if (len <= 0) {
+            continue;
+        }
+        memset(path, 0, sizeof(path));
+        fname_to_path(path, dir_path, name, len, 0, 0);
+        if (!rec_catalog_add(path, &hdr, NULL)) {
+            n++;
+        }
+    }
+    fscan_release(fs);
+
+    return n;
+}
+
+//插卡/进录音模式时调用，可作为wait_completion的回调
+//只扫描最后一条索引所在月份及之后的目录，已收录的文件按开始时间跳过
+int rec_catalog_rebuild(void *priv)
+{
+    struct rec_catalog_entry last;
+    struct vfscan *dir_list;
+    FILE *dir;
+    char last_month[8] = {0};
+    char name[16];
+    u32 last_time = 0;
+    int len, n = 0;
+
+    if (!rec_catalog_last(&last)) {
+        last_time = last.start_time;
+        memcpy(last_month, last.path, 7);
+    }
+
+    dir_list = fscan(CONFIG_ROOT_PATH, "-d -sn", 1);
+    if (!dir_list) {
+        return 0;
+    }
+    for (int i = 1; i <= dir_list->file_number; i++) {
+        dir = fselect(dir_list, FSEL_BY_NUMBER, i);
+        if (!dir) {
+            continue;
+        }
+        memset(name, 0, sizeof(name));
+        len = fget_name(dir, (u8 *)name, sizeof(name) - 1);
+        fclose(dir);
+        //只认录音的年月目录YYYY-MM
+        if (len != 7 || name[4] != '-') {
+            continue;
+        }
+        if (last_month[0] && strncmp(name, last_month, 7) < 0) {
+            continue;
+        }
+        n += rec_catalog_scan_dir(name, len, last_time);
+    }
+    fscan_release(dir_list);
+
+    if (n) {
+        log_i("rec catalog rebuild add %d\n", n);
+    }
+
+    return 0;
+}
+
+#endif
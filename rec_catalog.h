@@ -0,0 +1,49 @@
+/*
+@file: rec_catalog.h
+@brief: 录音文件目录索引
+@date: 2026/10/19
+*/
+#ifndef _REC_CATALOG_H_
+#define _REC_CATALOG_H_
+
+#include "rec_container.h"
+
+#define REC_CATALOG_ENABLE      // 录音目录索引开关
+
+#ifdef REC_CATALOG_ENABLE
+
+#define REC_CATALOG_FILE        CONFIG_ROOT_PATH"RECORDER.CAT"
+#define REC_CATALOG_MAGIC       0x54414352  // "RCAT"
+#define REC_CATALOG_PATH_MAX    66
+#define REC_CATALOG_SEG_MAX     REC_CONTAINER_SEG_KEEP
+
+#define REC_CATALOG_F_RECOVERED BIT(0)      // 掉电恢复的文件
+#define REC_CATALOG_F_NO_SEG    BIT(1)      // 插卡重建的条目，没有段偏移
+
+//定长128字节，按录音结束顺序追加，第n条在n*128处
+struct rec_catalog_entry {
+    u32 magic;
+    u32 start_time;                 // 录音开始的UTC时间
+    u32 duration_ms;
+    u32 size;                       // 有效数据长度(容器data_end)
+    u32 sample_rate;
+    u8  channel;
+    u8  flags;
+    u16 segment_count;
+    char format[8];
+    u32 seg_offset[REC_CATALOG_SEG_MAX];    // 前几个语音段标记块的文件偏移
+    u16 path_len;
+    char path[REC_CATALOG_PATH_MAX];        // 相对CONFIG_ROOT_PATH的路径
+    u32 crc;                        // 以上字段的CRC32
+};
+
+int rec_catalog_add(const char *path, const struct rec_container_hdr *hdr, const u32 *seg_offset);
+int rec_catalog_count(void);
+int rec_catalog_read(int index, struct rec_catalog_entry *e);
+int rec_catalog_last(struct rec_catalog_entry *e);
+int rec_catalog_get_path(const struct rec_catalog_entry *e, char *buf, int size);
+int rec_catalog_rebuild(void *priv);
+
+#endif
+
+#endif
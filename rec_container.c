@@ -0,0 +1,530 @@
+/*
+@file: rec_container.c
+@brief: 分块防掉电录音容器
+        文件按大块预分配(补零)，数据按块写入，每块带长度和CRC，
+        定时重写文件头作为检查点，掉电后开机扫描截断到最后一个完整块；
+        第一块存一份流信息，检查点写到一半掉电时文件头靠它恢复；
+        预分配由后台任务在写入位置前面提前补，编码器写卡路径上最多补一个块的空间
+@date: 2026/10/19
+*/
+
+#include <stddef.h>
+#include <time.h>
+#include "os/os_api.h"
+#include "app_config.h"
+#include "fs/fs.h"
+#include "system/timer.h"
+#include "rec_container.h"
+#include "rec_catalog.h"
+
+#ifdef REC_CONTAINER_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[REC_CT]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+static u8 zero_block[4096];     // 预分配时补零用
+static struct rec_container *open_list[REC_CONTAINER_MAX_OPEN];
+static OS_MUTEX dirty_mutex;
+static u8 dirty_mutex_init;
+
+//标记文件里记录所有还没关闭的容器，[u16 len][path]依次排列，全部关闭后删除
+static void rec_dirty_update(struct rec_container *add, struct rec_container *del)
+{
+    FILE *fp;
+    int i, n = 0;
+
+    if (!dirty_mutex_init) {
+        os_mutex_create(&dirty_mutex);
+        dirty_mutex_init = 1;
+    }
+    os_mutex_pend(&dirty_mutex, 0);
+
+    for (i = 0; i < REC_CONTAINER_MAX_OPEN; i++) {
+        if (del && open_list[i] == del) {
+            open_list[i] = NULL;
+        }
+        if (add && !open_list[i]) {
+            open_list[i] = add;
+            add = NULL;
+        }
+        if (open_list[i]) {
+            n++;
+        }
+    }
+
+    if (n) {
+        fp = fopen(REC_DIRTY_FILE, "w+");
+        if (fp) {
+            for (i = 0; i < REC_CONTAINER_MAX_OPEN; i++) {
+                if (open_list[i]) {
+                    fwrite(&open_list[i]->path_len, sizeof(u16), 1, fp);
+                    fwrite(open_list[i]->path, open_list[i]->path_len, 1, fp);
+                }
+            }
+            fclose(fp);
+        }
+    } else {
+        fp = fopen(REC_DIRTY_FILE, "r");
+        if (fp) {
+            fdelete(fp);
+        }
+    }
+
+    os_mutex_post(&dirty_mutex);
+}
+
+static int rec_write_hdr(FILE *fp, struct rec_container_hdr *hdr)
+{
+    hdr->crc = file_crc32(0, hdr, offsetof(struct rec_container_hdr, crc));
+    fseek(fp, 0, SEEK_SET);
+    if (fwrite(hdr, sizeof(*hdr), 1, fp) != sizeof(*hdr)) {
+        return -1;
+    }
+    return 0;
+}
+
+//在文件尾部追加一小段补零的空间，调用方持有ct->mutex
+static int rec_extend_block(struct rec_container *ct)
+{
+    fseek(ct->fp, ct->hdr.prealloc_len, SEEK_SET);
+    if (fwrite(zero_block, sizeof(zero_block), 1, ct->fp) != sizeof(zero_block)) {
+        log_e("rec container extend fail\n");
+        return -1;
+    }
+    ct->hdr.prealloc_len += sizeof(zero_block);
+
+    return 0;
+}
+
+//补零预分配到写入位置后面ahead字节，使FAT簇链提前分配；
+//每小段单独加锁，编码器写块最多等一次4K写
+static int rec_extend(struct rec_container *ct, u32 ahead)
+{
+    int err = 0;
+
+    while (!err) {
+        os_mutex_pend(&ct->mutex, 0);
+        if (ct->hdr.prealloc_len >= ct->hdr.data_end + ahead) {
+            os_mutex_post(&ct->mutex);
+            break;
+        }
+        err = rec_extend_block(ct);
+        os_mutex_post(&ct->mutex);
+    }
+    log_info("extend to %d", ct->hdr.prealloc_len);
+
+    return err;
+}
+
+static int rec_write_chunk(struct rec_container *ct, u8 type, u32 time_ms, void *data, u32 len)
+{
+    struct rec_chunk_hdr ch;
+    int err = -1;
+
+    os_mutex_pend(&ct->mutex, 0);
+
+    //后台没来得及补时只补够这一块；尾部至少留出一个空块头，保证恢复扫描能停在全零处
+    while (ct->hdr.data_end + 2 * sizeof(ch) + len > ct->hdr.prealloc_len) {
+        if (rec_extend_block(ct)) {
+            goto __exit;
+        }
+    }
+
+    ch.magic    = REC_CHUNK_MAGIC;
+    ch.seq      = ct->hdr.chunk_count;
+    ch.len      = len;
+    ch.time_ms  = time_ms;
+    ch.type     = type;
+    memset(ch.reserved, 0, sizeof(ch.reserved));
+    ch.crc = file_crc32(0, &ch.seq, offsetof(struct rec_chunk_hdr, crc) - offsetof(struct rec_chunk_hdr, seq));
+    ch.crc = file_crc32(ch.crc, data, len);
+
+    fseek(ct->fp, ct->hdr.data_end, SEEK_SET);
+    if (fwrite(&ch, sizeof(ch), 1, ct->fp) != sizeof(ch) ||
+        fwrite(data, len, 1, ct->fp) != len) {
+        log_e("rec container write chunk fail\n");
+        goto __exit;
+    }
+
+    ct->hdr.data_end += sizeof(ch) + len;
+    ct->hdr.chunk_count++;
+    err = 0;
+
+__exit:
+    os_mutex_post(&ct->mutex);
+    return err;
+}
+
+static int rec_flush_chunk(struct rec_container *ct)
+{
+    if (!ct->chunk_len) {
+        return 0;
+    }
+    if (rec_write_chunk(ct, REC_CHUNK_AUDIO, ct->chunk_time_ms, ct->chunk_buf, ct->chunk_len)) {
+        return -1;
+    }
+    ct->chunk_len = 0;
+
+    return 0;
+}
+
+//新语音段开始，采集通路调用，只置标记，由编码器写文件时落盘
+void rec_container_mark_segment(struct rec_container *ct)
+{
+    ct->segment_time_ms = timer_get_ms() - ct->start_ms;
+    ct->segment_pending = 1;
+}
+
+static int rec_write_segment(struct rec_container *ct)
+{
+    struct rec_segment seg;
+
+    ct->segment_pending = 0;
+    if (rec_flush_chunk(ct)) {
+        return -1;
+    }
+    seg.index = ct->hdr.segment_count;
+    seg.time_ms = ct->segment_time_ms;
+    if (seg.index < REC_CONTAINER_SEG_KEEP) {
+        ct->seg_offset[seg.index] = ct->hdr.data_end;
+    }
+    if (rec_write_chunk(ct, REC_CHUNK_SEGMENT, seg.time_ms, &seg, sizeof(seg))) {
+        return -1;
+    }
+    ct->hdr.segment_count++;
+
+    return 0;
+}
+
+struct rec_container *rec_container_open(const char *path, int sample_rate, u8 channel, const char *format)
+{
+    struct rec_container *ct = zalloc(sizeof(*ct));
+
+    if (!ct) {
+        return NULL;
+    }
+    ct->path_len = file_path_len(path);
+    if (ct->path_len >= REC_PATH_MAX - 2) {
+        goto __err;
+    }
+    memcpy(ct->path, path, ct->path_len);
+    os_mutex_create(&ct->mutex);
+    ct->chunk_buf = malloc(REC_CONTAINER_CHUNK_SIZE);
+    if (!ct->chunk_buf) {
+        goto __err;
+    }
+    ct->fp = fopen(path, "w+");
+    if (!ct->fp) {
+        goto __err;
+    }
+
+    ct->hdr.magic       = REC_CONTAINER_MAGIC;
+    ct->hdr.version     = REC_CONTAINER_VERSION;
+    ct->hdr.hdr_size    = REC_CONTAINER_HDR_SIZE;
+    ct->hdr.sample_rate = sample_rate;
+    ct->hdr.channel     = channel;
+    strncpy(ct->hdr.format, format, sizeof(ct->hdr.format) - 1);
+    ct->hdr.data_end    = REC_CONTAINER_HDR_SIZE;
+    ct->hdr.start_time  = time(NULL);
+
+    //打开时只同步补头部扇区和开头几块，按键和切换文件的路径上不等整段补零
+    if (rec_extend(ct, REC_CONTAINER_FIRST_EXTENT) || rec_write_hdr(ct->fp, &ct->hdr)) {
+        goto __err;
+    }
+
+    ct->start_ms = ct->last_checkpoint_ms = timer_get_ms();
+    rec_dirty_update(ct, NULL);
+
+    return ct;
+
+__err:
+    if (ct->fp) {
+        fclose(ct->fp);
+    }
+    if (ct->chunk_buf) {
+        free(ct->chunk_buf);
+    }
+    os_mutex_del(&ct->mutex, OS_DEL_ALWAYS);
+    free(ct);
+    return NULL;
+}
+
+int rec_container_checkpoint(struct rec_container *ct)
+{
+    int err;
+
+    if (rec_flush_chunk(ct)) {
+        return -1;
+    }
+    ct->hdr.duration_ms = timer_get_ms() - ct->start_ms;
+    os_mutex_pend(&ct->mutex, 0);
+    ct->hdr.seq++;
+    err = rec_write_hdr(ct->fp, &ct->hdr);
+    fflush(ct->fp);
+    os_mutex_post(&ct->mutex);
+    ct->last_checkpoint_ms = timer_get_ms();
+
+    return err;
+}
+
+//写入位置后面剩余的预分配空间不多了，写入方据此通知后台
+int rec_container_need_extend(struct rec_container *ct)
+{
+    return ct->hdr.prealloc_len - ct->hdr.data_end < REC_CONTAINER_EXTEND_AHEAD;
+}
+
+//后台任务调用，在写入位置前面补一整段预分配
+int rec_container_extend(struct rec_container *ct)
+{
+    return rec_extend(ct, REC_CONTAINER_EXTENT_SIZE);
+}
+
+//第一次写入前落盘，开始时间此时已经对齐(预开的文件在begin里重设)
+static int rec_write_info(struct rec_container *ct)
+{
+    struct rec_stream_info info = {0};
+
+    info.sample_rate = ct->hdr.sample_rate;
+    info.channel     = ct->hdr.channel;
+    info.start_time  = ct->hdr.start_time;
+    memcpy(info.format, ct->hdr.format, sizeof(info.format));
+
+    return rec_write_chunk(ct, REC_CHUNK_INFO, 0, &info, sizeof(info));
+}
+
+int rec_container_write(struct rec_container *ct, const void *data, u32 len)
+{
+    const u8 *p = (const u8 *)data;
+    u32 remain = len;
+
+    if (!ct->hdr.chunk_count && rec_write_info(ct)) {
+        return -1;
+    }
+
+    //段标记放在新语音段的第一块数据前面
+    if (ct->segment_pending && rec_write_segment(ct)) {
+        return -1;
+    }
+
+    while (remain) {
+        if (!ct->chunk_len) {
+            ct->chunk_time_ms = timer_get_ms() - ct->start_ms;
+        }
+        u32 wlen = REC_CONTAINER_CHUNK_SIZE - ct->chunk_len;
+        if (wlen > remain) {
+            wlen = remain;
+        }
+        memcpy(ct->chunk_buf + ct->chunk_len, p, wlen);
+        ct->chunk_len += wlen;
+        p += wlen;
+        remain -= wlen;
+        if (ct->chunk_len == REC_CONTAINER_CHUNK_SIZE && rec_flush_chunk(ct)) {
+            return -1;
+        }
+    }
+
+    if (timer_get_ms() - ct->last_checkpoint_ms >= REC_CONTAINER_CHECKPOINT_SEC * 1000) {
+        if (rec_container_checkpoint(ct)) {
+            return -1;
+        }
+    }
+
+    return len;
+}
+
+int rec_container_close(struct rec_container *ct)
+{
+    int err;
+
+    if (!ct) {
+        return 0;
+    }
+    //文件长度保持预分配大小，读取方以文件头的data_end为准
+    ct->hdr.flags |= REC_FLAG_FINALIZED;
+    err = rec_container_checkpoint(ct);
+    fclose(ct->fp);
+    rec_dirty_update(NULL, ct);
+#ifdef REC_CATALOG_ENABLE
+    if (!err) {
+        rec_catalog_add(ct->path, &ct->hdr, ct->seg_offset);
+    }
+#endif
+    log_info("close: data_end %d chunks %d", ct->hdr.data_end, ct->hdr.chunk_count);
+
+    os_mutex_del(&ct->mutex, OS_DEL_ALWAYS);
+    free(ct->chunk_buf);
+    free(ct);
+
+    return err;
+}
+
+//预先打开的容器真正开始写入时，重新对齐开始时间
+void rec_container_begin(struct rec_container *ct)
+{
+    ct->hdr.start_time = time(NULL);
+    ct->start_ms = ct->last_checkpoint_ms = timer_get_ms();
+}
+
+//预先打开但没用上的容器，直接删除文件
+void rec_container_discard(struct rec_container *ct)
+{
+    if (!ct) {
+        return;
+    }
+    fdelete(ct->fp);
+    rec_dirty_update(NULL, ct);
+    os_mutex_del(&ct->mutex, OS_DEL_ALWAYS);
+    free(ct->chunk_buf);
+    free(ct);
+}
+
+//从最后一个检查点往后逐块校验，截断到最后一个完整块，返回有效块数
+int rec_container_recover(const char *path)
+{
+    struct rec_container_hdr hdr;
+    struct rec_chunk_hdr ch;
+    struct rec_stream_info *info;
+    u32 pos, file_len, crc;
+    u8 *buf;
+    int recovered = 0;
+    int ret = -1;
+
+    FILE *fp = fopen(path, "r+");
+    if (!fp) {
+        return -1;
+    }
+    buf = malloc(REC_CONTAINER_CHUNK_SIZE);
+    if (!buf) {
+        fclose(fp);
+        return -1;
+    }
+
+    file_len = flen(fp);
+    if (fread(&hdr, sizeof(hdr), 1, fp) != sizeof(hdr) || hdr.magic != REC_CONTAINER_MAGIC) {
+        goto __exit;
+    }
+    if (hdr.crc != file_crc32(0, &hdr, offsetof(struct rec_container_hdr, crc))) {
+        //头部损坏时里面的字段都不可信，只留魔数和版本，从头扫描；
+        //采样率、声道、格式和开始时间从第一块流信息里恢复
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.magic    = REC_CONTAINER_MAGIC;
+        hdr.version  = REC_CONTAINER_VERSION;
+        hdr.hdr_size = REC_CONTAINER_HDR_SIZE;
+        hdr.data_end = REC_CONTAINER_HDR_SIZE;
+    } else if (hdr.data_end < REC_CONTAINER_HDR_SIZE || hdr.data_end > file_len) {
+        //文件被截短过，按未关闭处理重新扫描
+        hdr.data_end = REC_CONTAINER_HDR_SIZE;
+        hdr.chunk_count = 0;
+        hdr.segment_count = 0;
+        hdr.flags &= ~REC_FLAG_FINALIZED;
+    }
+    if (hdr.flags & REC_FLAG_FINALIZED) {
+        ret = hdr.chunk_count;
+        goto __exit;
+    }
+
+    pos = hdr.data_end;
+    while (pos + sizeof(ch) <= file_len) {
+        fseek(fp, pos, SEEK_SET);
+        if (fread(&ch, sizeof(ch), 1, fp) != sizeof(ch) ||
+            ch.magic != REC_CHUNK_MAGIC || ch.seq != hdr.chunk_count ||
+            ch.len == 0 || ch.len > REC_CONTAINER_CHUNK_SIZE || pos + sizeof(ch) + ch.len > file_len) {
+            break;
+        }
+        if (fread(buf, ch.len, 1, fp) != ch.len) {
+            break;
+        }
+        crc = file_crc32(0, &ch.seq, offsetof(struct rec_chunk_hdr, crc) - offsetof(struct rec_chunk_hdr, seq));
+        crc = file_crc32(crc, buf, ch.len);
+        if (crc != ch.crc) {
+            break;
+        }
+        pos += sizeof(ch) + ch.len;
+        hdr.chunk_count++;
+        if (ch.type == REC_CHUNK_SEGMENT) {
+            hdr.segment_count++;
+        } else if (ch.type == REC_CHUNK_INFO && ch.len >= sizeof(*info)) {
+            info = (struct rec_stream_info *)buf;
+            hdr.sample_rate = info->sample_rate;
+            hdr.channel     = info->channel;
+            hdr.start_time  = info->start_time;
+            memcpy(hdr.format, info->format, sizeof(hdr.format));
+        }
+        hdr.duration_ms = ch.time_ms;
+        recovered++;
+    }
+
+    //清掉残缺块的块头，后续读取自然停在data_end
+    if (pos + sizeof(ch) <= file_len) {
+        fseek(fp, pos, SEEK_SET);
+        fwrite(zero_block, sizeof(ch), 1, fp);
+    }
+    hdr.data_end = pos;
+    hdr.prealloc_len = file_len;
+    hdr.flags |= REC_FLAG_FINALIZED | REC_FLAG_RECOVERED;
+    hdr.seq++;
+    rec_write_hdr(fp, &hdr);
+
+    log_i("rec container recovered %d chunks, data_end %d\n", recovered, pos);
+    ret = hdr.chunk_count;
+
+__exit:
+    free(buf);
+    fclose(fp);
+    return ret;
+}
+
+//开机时只检查标记文件，不需要扫描目录
+int rec_container_recover_pending(void)
+{
+    char path[REC_PATH_MAX];
+    u16 len = 0;
+    int n = 0;
+    FILE *file;
+
+    FILE *fp = fopen(REC_DIRTY_FILE, "r");
+    if (!fp) {
+        return 0;
+    }
+    while (fread(&len, sizeof(len), 1, fp) == sizeof(len) && len > 0 && len < sizeof(path) - 2) {
+        memset(path, 0, sizeof(path));
+        if (fread(path, len, 1, fp) != len) {
+            break;
+        }
+        //一块数据都没有的是预开的下一个文件，直接删掉
+        if (rec_container_recover(path) == 0) {
+            file = fopen(path, "r");
+            if (file) {
+                fdelete(file);
+            }
+        }
+        n++;
+    }
+    fdelete(fp);
+
+    return n;
+}
+
+static int rec_container_vfs_fwrite(void *file, void *data, u32 len)
+{
+    //返回0编码器会停止录音
+    if (rec_container_write((struct rec_container *)file, data, len) < 0) {
+        return 0;
+    }
+    return len;
+}
+
+static int rec_container_vfs_fclose(void *file)
+{
+    return 0;
+}
+
+const struct audio_vfs_ops rec_container_vfs_ops = {
+    .fwrite = rec_container_vfs_fwrite,
+    .fclose = rec_container_vfs_fclose,
+};
+
+#endif
@@ -0,0 +1,120 @@
+/*
+@file: rec_container.h
+@brief: 分块防掉电录音容器
+@date: 2026/10/19
+*/
+#ifndef _REC_CONTAINER_H_
+#define _REC_CONTAINER_H_
+
+#include "server/audio_server.h"
+#include "fs/fs.h"
+#include "file_util.h"
+
+#define REC_CONTAINER_ENABLE    // 分块录音容器总开关
+
+#ifdef REC_CONTAINER_ENABLE
+
+#define REC_CONTAINER_MAGIC         0x43524c4a  // "JLRC"
+#define REC_CHUNK_MAGIC             0x4b4e4843  // "CHNK"
+#define REC_CONTAINER_VERSION       1
+#define REC_CONTAINER_HDR_SIZE      512                 // 文件头占一个扇区
+#define REC_CONTAINER_EXTENT_SIZE   (1 * 1024 * 1024)   // 每次预分配的空间
+#define REC_CONTAINER_FIRST_EXTENT  (16 * 1024)         // 打开时同步预分配的空间，其余由后台补
+#define REC_CONTAINER_EXTEND_AHEAD  (256 * 1024)        // 写入位置后面剩余的预分配空间少于这么多时由后台补
+#define REC_CONTAINER_CHUNK_SIZE    (8 * 1024)          // 单个数据块最大负载
+#define REC_CONTAINER_CHECKPOINT_SEC 5                  // 文件头检查点间隔(秒)
+#define REC_CONTAINER_EXT           "jrc"
+
+#define REC_DIRTY_FILE              CONFIG_ROOT_PATH"REC_DIRTY.BIN"  // 记录未正常关闭的录音文件
+#define REC_CONTAINER_MAX_OPEN      3       // 同时打开的容器数(当前文件+预开的下一个+待关闭的)
+#define REC_PATH_MAX                128
+#define REC_CONTAINER_SEG_KEEP      6       // 记录前几个语音段的文件偏移，给目录索引用
+
+#define REC_FLAG_FINALIZED          BIT(0)  // 正常关闭
+#define REC_FLAG_RECOVERED          BIT(1)  // 掉电后恢复
+
+enum {
+    REC_CHUNK_AUDIO = 0,
+    REC_CHUNK_SEGMENT,      // VAD分段标记，负载为struct rec_segment
+    REC_CHUNK_INFO,         // 流信息，总是第一块，负载为struct rec_stream_info
+};
+
+struct rec_segment {
+    u32 index;
+    u32 time_ms;            // 语音段开始时间(相对录音开始)
+};
+
+//文件头里不会变的字段再存一份，只写一次，文件头检查点写坏时从这里恢复
+struct rec_stream_info {
+    u32 sample_rate;
+    u8  channel;
+    u8  reserved[3];
+    char format[8];
+    u32 start_time;
+};
+
+//文件头，每个检查点整体重写
+struct rec_container_hdr {
+    u32 magic;
+    u16 version;
+    u16 hdr_size;
+    u32 sample_rate;
+    u8  channel;
+    u8  reserved[3];
+    char format[8];
+    u32 prealloc_len;   // 已预分配的文件长度
+    u32 data_end;       // 最后一个有效块的结束位置
+    u32 chunk_count;
+    u32 start_time;     // 录音开始的UTC时间
+    u32 duration_ms;    // 截止到检查点的录音时长
+    u32 flags;
+    u32 segment_count;  // VAD语音段数
+    u32 seq;            // 检查点序号
+    u32 crc;            // 以上字段的CRC32
+};
+
+//数据块头，crc覆盖seq/len/time_ms/type和负载
+struct rec_chunk_hdr {
+    u32 magic;
+    u32 seq;
+    u32 len;
+    u32 time_ms;        // 块起始位置相对录音开始的时间
+    u8  type;
+    u8  reserved[3];
+    u32 crc;
+};
+
+struct rec_container {
+    FILE *fp;
+    char path[REC_PATH_MAX];
+    u16 path_len;
+    struct rec_container_hdr hdr;
+    u8 *chunk_buf;
+    u32 chunk_len;
+    u32 chunk_time_ms;
+    u32 start_ms;
+    u32 last_checkpoint_ms;
+    volatile u8 segment_pending;
+    u32 segment_time_ms;
+    u32 seg_offset[REC_CONTAINER_SEG_KEEP];
+    OS_MUTEX mutex;     // 编码器写块和后台预分配互斥，按4K一小段持有
+};
+
+struct rec_container *rec_container_open(const char *path, int sample_rate, u8 channel, const char *format);
+int rec_container_write(struct rec_container *ct, const void *data, u32 len);
+int rec_container_checkpoint(struct rec_container *ct);
+int rec_container_need_extend(struct rec_container *ct);
+int rec_container_extend(struct rec_container *ct);
+void rec_container_mark_segment(struct rec_container *ct);
+int rec_container_close(struct rec_container *ct);
+void rec_container_discard(struct rec_container *ct);
+void rec_container_begin(struct rec_container *ct);
+int rec_container_recover(const char *path);
+int rec_container_recover_pending(void);
+
+//供编码器直接写入容器
+extern const struct audio_vfs_ops rec_container_vfs_ops;
+
+#endif
+
+#endif
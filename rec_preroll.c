@@ -0,0 +1,213 @@
+/*
+@file: rec_preroll.c
+@brief: 录音预录环形缓冲
+        采集通路一直往环形缓冲写PCM，空闲时只保留最近REC_PREROLL_MS的数据；
+        开始录音后编码器以虚拟源从同一个缓冲取数，预录数据自然排在实时数据前面，
+        不需要提前打开编码器
+@date: 2026/10/19
+*/
+
+#include "os/os_api.h"
+#include "app_config.h"
+#include "generic/circular_buf.h"
+#include "rec_preroll.h"
+
+#ifdef REC_PREROLL_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[PREROLL]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+static struct rec_preroll preroll_hdl;
+
+#define __this (&preroll_hdl)
+
+int rec_preroll_open(int sample_rate, u8 channel)
+{
+    u32 bytes_per_ms = sample_rate / 1000 * channel * 2;
+    u32 size;
+
+    //重复打开时保留已有的预录数据
+    if (__this->buf) {
+        if (__this->sample_rate == sample_rate && __this->channel == channel) {
+            return 0;
+        }
+        rec_preroll_close();
+    }
+
+    size = bytes_per_ms * (REC_PREROLL_MS + REC_PREROLL_MARGIN_MS);
+    __this->buf = malloc(size);
+    if (!__this->buf) {
+        return -1;
+    }
+    cbuf_init(&__this->cbuf, __this->buf, size);
+    __this->size = size;
+    os_sem_create(&__this->sem, 0);
+    __this->preroll_len = bytes_per_ms * REC_PREROLL_MS;
+    __this->sample_rate = sample_rate;
+    __this->channel = channel;
+    __this->recording = 0;
+    __this->paused = 0;
+    __this->overrun = 0;
+
+    log_info("open: %dHz %dch preroll %d bytes", sample_rate, channel, __this->preroll_len);
+
+    return 0;
+}
+
+void rec_preroll_close(void)
+{
+    void *buf;
+
+    if (!__this->buf) {
+        return;
+    }
+    rec_preroll_stop();
+
+    local_irq_disable();
+    buf = __this->buf;
+    __this->buf = NULL;
+    local_irq_enable();
+
+    os_sem_del(&__this->sem, OS_DEL_ALWAYS);
+    free(buf);
+}
+
+int rec_preroll_ready(void)
+{
+    return __this->buf != NULL;
+}
+
+u8 rec_preroll_is_recording(void)
+{
+    return __this->recording;
+}
+
+int rec_preroll_sample_rate(void)
+{
+    return __this->sample_rate;
+}
+
+u8 rec_preroll_channel(void)
+{
+    return __this->channel;
+}
+
+//采集通路调用，不能阻塞
+void rec_preroll_write(const void *data, u32 len)
+{
+    u32 limit, size, drop;
+
+    if (!__this->buf) {
+        return;
+    }
+
+    //空闲时只留预录长度；录音时编码器来不及取就丢最旧的数据；
+    //暂停时静音接在还没取走的语音后面，语音取完后静音只留最近一小段给下一段语音开头，
+    //语音没取完时静音先不裁，缓冲真满了才丢语音
+    if (!__this->recording) {
+        limit = __this->preroll_len;
+    } else if (__this->paused && !__this->drain_len) {
+        limit = __this->gap_len;
+    } else {
+        limit = __this->size;
+    }
+    if (len > limit) {
+        data = (const u8 *)data + (len - limit);
+        len = limit;
+    }
+    size = cbuf_get_data_size(&__this->cbuf);
+    if (size + len > limit) {
+        drop = size + len - limit;
+        cbuf_read_updata(&__this->cbuf, drop);
+        if (__this->paused) {
+            //丢掉的是最旧的语音，待取的长度跟着减，编码器不会读进静音里
+            drop = MIN(drop, __this->drain_len);
+            __this->drain_len -= drop;
+            __this->overrun += drop;
+        } else if (__this->recording) {
+            __this->overrun += drop;
+        }
+    }
+    cbuf_write(&__this->cbuf, (void *)data, len);
+
+    if (__this->recording) {
+        os_sem_set(&__this->sem, 0);
+        os_sem_post(&__this->sem);
+    }
+}
+
+//开始录音：缓冲里现有的预录数据会先被编码
+int rec_preroll_start(void)
+{
+    if (!__this->buf) {
+        return -1;
+    }
+    __this->overrun = 0;
+    __this->paused = 0;
+    __this->recording = 1;
+    log_info("start with %d bytes preroll", cbuf_get_data_size(&__this->cbuf));
+    return 0;
+}
+
+void rec_preroll_stop(void)
+{
+    if (!__this->recording) {
+        return;
+    }
+    __this->recording = 0;
+    os_sem_post(&__this->sem);
+    if (__this->overrun) {
+        log_w("preroll overrun %d bytes\n", __this->overrun);
+    }
+}
+
+//静音暂停/恢复，采集通路调用
+void rec_preroll_pause(u8 pause, u32 keep_ms)
+{
+    if (pause == __this->paused) {
+        return;
+    }
+    if (pause) {
+        __this->gap_len = __this->sample_rate / 1000 * __this->channel * 2 * keep_ms;
+        __this->drain_len = cbuf_get_data_size(&__this->cbuf);
+        __this->paused = 1;
+    } else {
+        __this->paused = 0;
+        __this->drain_len = 0;
+        os_sem_set(&__this->sem, 0);
+        os_sem_post(&__this->sem);
+    }
+}
+
+//编码器虚拟源输入，凑够一帧再返回，停止录音时返回0
+//暂停期间取完剩余数据后在这里阻塞，编码器不再产出，也就不会写卡
+u32 rec_preroll_read_input(u8 *buf, u32 len)
+{
+    u32 rlen;
+
+    while (__this->recording) {
+        local_irq_disable();
+        rlen = cbuf_get_data_size(&__this->cbuf);
+        //暂停前的语音最后不满一帧时，连同后面一点静音凑成整帧取走
+        if (__this->paused && !__this->drain_len) {
+            rlen = 0;
+        }
+        if (rlen >= len) {
+            rlen = cbuf_read(&__this->cbuf, buf, len);
+            if (__this->paused) {
+                __this->drain_len -= MIN(rlen, __this->drain_len);
+            }
+            local_irq_enable();
+            return rlen;
+        }
+        local_irq_enable();
+        os_sem_pend(&__this->sem, 0);
+    }
+
+    return 0;
+}
+
+#endif
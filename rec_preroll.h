@@ -0,0 +1,48 @@
+/*
+@file: rec_preroll.h
+@brief: 录音预录环形缓冲
+@date: 2026/10/19
+*/
+#ifndef _REC_PREROLL_H_
+#define _REC_PREROLL_H_
+
+#include "generic/circular_buf.h"
+#include "os/os_api.h"
+
+#define REC_PREROLL_ENABLE      // 预录功能开关
+
+#ifdef REC_PREROLL_ENABLE
+
+#define REC_PREROLL_MS          2000    // 按键前保留的录音时长
+#define REC_PREROLL_MARGIN_MS   1000    // 录音时给编码器留的余量
+
+struct rec_preroll {
+    void *buf;
+    cbuffer_t cbuf;
+    OS_SEM sem;
+    u32 size;               // 缓冲总长度
+    u32 preroll_len;        // 空闲时保留的字节数
+    int sample_rate;
+    u8 channel;
+    volatile u8 recording;  // 1:编码器正在取数
+    volatile u8 paused;     // 1:静音段暂停送数，编码器和写卡都停下
+    u32 gap_len;            // 暂停期间保留的字节数
+    u32 drain_len;          // 暂停前已写入、编码器还可以继续取的字节数
+    u32 overrun;            // 录音时缓冲满丢掉的字节数
+};
+
+int rec_preroll_open(int sample_rate, u8 channel);
+void rec_preroll_close(void);
+int rec_preroll_ready(void);
+u8 rec_preroll_is_recording(void);
+int rec_preroll_sample_rate(void);
+u8 rec_preroll_channel(void);
+void rec_preroll_write(const void *data, u32 len);
+int rec_preroll_start(void);
+void rec_preroll_stop(void);
+void rec_preroll_pause(u8 pause, u32 keep_ms);
+u32 rec_preroll_read_input(u8 *buf, u32 len);
+
+#endif
+
+#endif
@@ -0,0 +1,218 @@
+/*
+@file: rec_rollover.c
+@brief: 长时间录音按大小/时长无缝切换文件
+        编码器一直不停，每次输出的编码帧整块写进当前文件；接近上限时后台任务
+        预先建目录、打开下一个文件并补好第一段预分配，到达上限后在两次编码输出之间换成新文件，
+        旧文件也交给后台关闭，当前文件的预分配也由后台提前补，写卡路径上不会等fopen/建目录/补零
+@date: 2026/10/19
+*/
+
+#include "os/os_api.h"
+#include "app_config.h"
+#include "rec_rollover.h"
+
+#ifdef REC_ROLLOVER_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[ROLLOVER]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+static struct rec_container *rec_rollover_open_part(struct rec_rollover *ro)
+{
+    char path[REC_PATH_MAX];
+
+    if (ro->get_name(path, sizeof(path), ro->part)) {
+        return NULL;
+    }
+    ro->part++;
+    return rec_container_open(path, ro->sample_rate, ro->channel, ro->format);
+}
+
+//后台任务：预开下一个文件，关闭切换下来的文件
+static void rec_rollover_task(void *priv)
+{
+    struct rec_rollover *ro = (struct rec_rollover *)priv;
+    struct rec_container *ct;
+
+    while (1) {
+        os_sem_pend(&ro->sem, 0);
+        if (ro->exit) {
+            break;
+        }
+
+        if (ro->closing) {
+            ct = ro->closing;
+            rec_container_close(ct);
+            ro->closing = NULL;
+            log_info("part closed");
+        }
+
+        //切换下来的文件只会由本任务关闭，这里拿到的cur不会被释放
+        if (ro->want_extend) {
+            if (rec_container_extend(ro->cur)) {
+                log_e("rec rollover extend err\n");
+            }
+            ro->want_extend = 0;
+        }
+
+        if (ro->want_next && !ro->next) {
+            ct = rec_rollover_open_part(ro);
+            //第一段预分配也在这里补完再交出去，切换时编码器不用等补零
+            if (ct && rec_container_extend(ct)) {
+                rec_container_discard(ct);
+                ct = NULL;
+            }
+            if (ct) {
+                ro->next = ct;
+                log_info("part %d preopened", ro->part - 1);
+            } else {
+                log_e("rec rollover preopen err\n");
+            }
+            ro->want_next = 0;
+        }
+    }
+}
+
+struct rec_rollover *rec_rollover_open(rec_rollover_name_t get_name, int sample_rate, u8 channel, const char *format)
+{
+    struct rec_rollover *ro = zalloc(sizeof(*ro));
+
+    if (!ro) {
+        return NULL;
+    }
+    ro->get_name = get_name;
+    ro->sample_rate = sample_rate;
+    ro->channel = channel;
+    strncpy(ro->format, format, sizeof(ro->format) - 1);
+
+    //第一个文件在按键时同步打开，打不开直接报错
+    ro->cur = rec_rollover_open_part(ro);
+    if (!ro->cur) {
+        goto __err;
+    }
+    ro->cur_start_ms = timer_get_ms();
+
+    os_sem_create(&ro->sem, 0);
+    if (thread_fork("rec_rollover", REC_ROLLOVER_TASK_PRIO, REC_ROLLOVER_TASK_STK, 0,
+                    &ro->pid, rec_rollover_task, ro)) {
+        os_sem_del(&ro->sem, OS_DEL_ALWAYS);
+        //一帧都没写，删掉文件，不留空的目录项
+        rec_container_discard(ro->cur);
+        goto __err;
+    }
+
+    return ro;
+
+__err:
+    free(ro);
+    return NULL;
+}
+
+int rec_rollover_close(struct rec_rollover *ro)
+{
+    int err;
+
+    if (!ro) {
+        return 0;
+    }
+    ro->exit = 1;
+    os_sem_post(&ro->sem);
+    thread_kill(&ro->pid, KILL_WAIT);
+    os_sem_del(&ro->sem, OS_DEL_ALWAYS);
+
+    if (ro->closing) {
+        rec_container_close(ro->closing);
+    }
+    if (ro->next) {
+        rec_container_discard(ro->next);
+    }
+    err = rec_container_close(ro->cur);
+    free(ro);
+
+    return err;
+}
+
+//采集中断里调用，只置标记
+void rec_rollover_mark_segment(struct rec_rollover *ro)
+{
+    ro->segment_pending = 1;
+}
+
+//1:已达到上限 2:接近上限需要预开
+static int rec_rollover_check(struct rec_rollover *ro)
+{
+    u32 ms = timer_get_ms() - ro->cur_start_ms;
+
+#if REC_ROLLOVER_MAX_SIZE
+    if (ro->cur_len >= REC_ROLLOVER_MAX_SIZE) {
+        return 1;
+    }
+    if (ro->cur_len >= REC_ROLLOVER_MAX_SIZE / 100 * REC_ROLLOVER_PREOPEN_PCT) {
+        return 2;
+    }
+#endif
+#if REC_ROLLOVER_MAX_SEC
+    if (ms >= REC_ROLLOVER_MAX_SEC * 1000) {
+        return 1;
+    }
+    if (ms >= REC_ROLLOVER_MAX_SEC * 10 * REC_ROLLOVER_PREOPEN_PCT) {
+        return 2;
+    }
+#endif
+    return 0;
+}
+
+static int rec_rollover_vfs_fwrite(void *file, void *data, u32 len)
+{
+    struct rec_rollover *ro = (struct rec_rollover *)file;
+    int ret;
+
+    ret = rec_rollover_check(ro);
+    if (ret && !ro->next && !ro->want_next) {
+        ro->want_next = 1;
+        os_sem_post(&ro->sem);
+    }
+    //上一个文件还没关完或下一个还没开好、预分配还没补够，继续写当前文件，不丢数据
+    if (ret == 1 && ro->next && !ro->closing && !rec_container_need_extend(ro->next)) {
+        ro->closing = ro->cur;
+        ro->cur = ro->next;
+        ro->next = NULL;
+        ro->cur_len = 0;
+        ro->cur_start_ms = timer_get_ms();
+        rec_container_begin(ro->cur);
+        os_sem_post(&ro->sem);
+        log_info("rollover to part %d", ro->part - 1);
+    }
+
+    if (ro->segment_pending) {
+        ro->segment_pending = 0;
+        rec_container_mark_segment(ro->cur);
+    }
+
+    //返回0编码器会停止录音
+    if (rec_container_write(ro->cur, data, len) < 0) {
+        return 0;
+    }
+    ro->cur_len += len;
+
+    if (!ro->want_extend && rec_container_need_extend(ro->cur)) {
+        ro->want_extend = 1;
+        os_sem_post(&ro->sem);
+    }
+
+    return len;
+}
+
+static int rec_rollover_vfs_fclose(void *file)
+{
+    return 0;
+}
+
+const struct audio_vfs_ops rec_rollover_vfs_ops = {
+    .fwrite = rec_rollover_vfs_fwrite,
+    .fclose = rec_rollover_vfs_fclose,
+};
+
+#endif
@@ -0,0 +1,53 @@
+/*
+@file: rec_rollover.h
+@brief: 长时间录音按大小/时长无缝切换文件
+@date: 2026/10/19
+*/
+#ifndef _REC_ROLLOVER_H_
+#define _REC_ROLLOVER_H_
+
+#include "os/os_api.h"
+#include "rec_container.h"
+
+#define REC_ROLLOVER_ENABLE     // 录音文件自动切分开关
+
+#ifdef REC_ROLLOVER_ENABLE
+
+#define REC_ROLLOVER_MAX_SIZE       (64 * 1024 * 1024)  // 单个文件最大数据量，0:不按大小切分
+#define REC_ROLLOVER_MAX_SEC        (30 * 60)           // 单个文件最长时长，0:不按时长切分
+#define REC_ROLLOVER_PREOPEN_PCT    90                  // 达到上限的百分比后预开下一个文件
+#define REC_ROLLOVER_TASK_PRIO      6                   // 后台开关文件任务优先级，低于编码和采集
+#define REC_ROLLOVER_TASK_STK       1024
+
+//生成第part个文件的路径，part从0开始，返回0成功
+typedef int (*rec_rollover_name_t)(char *buf, int size, int part);
+
+struct rec_rollover {
+    struct rec_container *cur;          // 编码器正在写的文件
+    struct rec_container *next;         // 后台预开好的下一个文件
+    struct rec_container *closing;      // 切换下来等后台关闭的文件
+    rec_rollover_name_t get_name;
+    int sample_rate;
+    u8 channel;
+    char format[8];
+    u16 part;                           // 下一个要打开的文件序号
+    u32 cur_len;                        // 当前文件已写入的编码数据
+    u32 cur_start_ms;
+    volatile u8 want_next;              // 需要预开下一个文件
+    volatile u8 want_extend;            // 当前文件需要补预分配
+    volatile u8 segment_pending;        // VAD段标记，下次写入时打到当前文件
+    volatile u8 exit;
+    OS_SEM sem;
+    int pid;
+};
+
+struct rec_rollover *rec_rollover_open(rec_rollover_name_t get_name, int sample_rate, u8 channel, const char *format);
+int rec_rollover_close(struct rec_rollover *ro);
+void rec_rollover_mark_segment(struct rec_rollover *ro);
+
+//供编码器直接写入，切换在两次编码输出之间完成
+extern const struct audio_vfs_ops rec_rollover_vfs_ops;
+
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+/*
+@file: rec_vad.c
+@brief: 录音用轻量VAD
+        每10ms算一次短时能量和过零率，底噪在静音段自适应跟踪；
+        浊音靠能量判决，清音靠能量+过零率判决，带起始确认和拖尾保持
+@date: 2026/10/19
+*/
+
+#include "app_config.h"
+#include "rec_vad.h"
+
+#ifdef REC_VAD_ENABLE
+
+#if 0
+#define log_info(x, ...)    printf("\n[REC_VAD]>" x " \n", ## __VA_ARGS__)
+#else
+#define log_info(...)
+#endif
+
+static struct rec_vad vad_hdl;
+static u8 vad_rec_enable;   // 分段录音模式，切换模式时不清除
+
+#define __this (&vad_hdl)
+
+void rec_vad_init(int sample_rate)
+{
+    memset(__this, 0, sizeof(*__this));
+    __this->frame_samples = sample_rate * REC_VAD_FRAME_MS / 1000;
+    __this->hang_frames = REC_VAD_HANGOVER_MS / REC_VAD_FRAME_MS;
+    __this->noise_floor = REC_VAD_MIN_ENERGY;
+    //开始时按语音处理，预录数据先正常写入，静音后再暂停
+    __this->speech = 1;
+    __this->hang = __this->hang_frames;
+}
+
+static u8 rec_vad_frame_decide(u32 energy, int zcr)
+{
+    u32 thr = __this->noise_floor << REC_VAD_SNR_SHIFT;
+
+    if (energy < REC_VAD_MIN_ENERGY) {
+        return 0;
+    }
+    if (energy > thr) {
+        return 1;
+    }
+    //清音能量低，能量过半门限且过零率落在清音范围内也算语音
+    if (energy > (thr >> 1) && zcr >= REC_VAD_ZCR_MIN && zcr <= REC_VAD_ZCR_MAX) {
+        return 1;
+    }
+    return 0;
+}
+
+static int rec_vad_frame_end(void)
+{
+    u32 energy = __this->energy_acc / __this->frame_samples;
+    int zcr = __this->zc * 100 / __this->frame_samples;
+    u8 active = rec_vad_frame_decide(energy, zcr) || __this->ext_speech;
+    int edge = REC_VAD_EDGE_NONE;
+
+    __this->energy_acc = 0;
+    __this->zc = 0;
+
+    if (!active) {
+        //只在非语音帧更新底噪，上升慢下降快
+        if (energy > __this->noise_floor) {
+            __this->noise_floor += (energy - __this->noise_floor) >> 5;
+        } else {
+            __this->noise_floor -= (__this->noise_floor - energy) >> 2;
+        }
+        if (__this->noise_floor < REC_VAD_MIN_ENERGY) {
+            __this->noise_floor = REC_VAD_MIN_ENERGY;
+        }
+    }
+
+    if (__this->speech) {
+        if (active) {
+            __this->hang = __this->hang_frames;
+        } else if (__this->hang && --__this->hang == 0) {
+            __this->speech = 0;
+            edge = REC_VAD_EDGE_STOP;
+            log_info("speech stop, floor %d", __this->noise_floor);
+        }
+    } else {
+        if (!active) {
+            __this->onset = 0;
+        } else if (++__this->onset >= REC_VAD_ONSET_FRAMES) {
+            __this->onset = 0;
+            __this->speech = 1;
+            __this->hang = __this->hang_frames;
+            edge = REC_VAD_EDGE_START;
+            log_info("speech start, energy %d zcr %d", energy, zcr);
+        }
+    }
+
+    return edge;
+}
+
+//返回本次数据内最后一次状态变化
+int rec_vad_process(const s16 *pcm, int samples)
+{
+    int edge = REC_VAD_EDGE_NONE;
+    int ret;
+
+    if (!__this->frame_samples) {
+        return REC_VAD_EDGE_NONE;
+    }
+
+    for (int i = 0; i < samples; i++) {
+        s16 x = pcm[i];
+        __this->energy_acc += (s32)x * x;
+        if ((x ^ __this->last) < 0) {
+            __this->zc++;
+        }
+        __this->last = x;
+        if (++__this->pos == __this->frame_samples) {
+            __this->pos = 0;
+            ret = rec_vad_frame_end();
+            if (ret != REC_VAD_EDGE_NONE) {
+                edge = ret;
+            }
+        }
+    }
+
+    return edge;
+}
+
+void rec_vad_enable(u8 en)
+{
+    vad_rec_enable = en;
+}
+
+u8 rec_vad_enabled(void)
+{
+    return vad_rec_enable;
+}
+
+//AUDIO_SERVER_EVENT_SPEAK_START/STOP
+void rec_vad_set_ext(u8 speech)
+{
+    __this->ext_speech = speech;
+}
+
+u8 rec_vad_is_speech(void)
+{
+    return __this->speech;
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*
+@file: rec_vad.h
+@brief: 录音用轻量VAD(短时能量+过零率)
+@date: 2026/10/19
+*/
+#ifndef _REC_VAD_H_
+#define _REC_VAD_H_
+
+#include "app_config.h"
+
+#define REC_VAD_ENABLE          // VAD分段录音开关
+
+#ifdef REC_VAD_ENABLE
+
+#define REC_VAD_FRAME_MS        10      // 分析帧长
+#define REC_VAD_ONSET_FRAMES    3       // 连续语音帧数才判为开始
+#define REC_VAD_HANGOVER_MS     600     // 静音持续多久判为结束
+#define REC_VAD_ONSET_KEEP_MS   300     // 静音期保留的音频，接在下一段开头
+#define REC_VAD_SNR_SHIFT       2       // 能量超过底噪4倍(约6dB)判为语音
+#define REC_VAD_MIN_ENERGY      (40 * 40)   // 绝对能量门限
+#define REC_VAD_ZCR_MIN         5       // 清音判决的过零率范围(每帧每百样本)
+#define REC_VAD_ZCR_MAX         50
+
+enum {
+    REC_VAD_EDGE_NONE = 0,
+    REC_VAD_EDGE_START,
+    REC_VAD_EDGE_STOP,
+};
+
+struct rec_vad {
+    int frame_samples;
+    int pos;
+    u64 energy_acc;
+    int zc;
+    s16 last;
+    u32 noise_floor;
+    u8 speech;
+    u8 ext_speech;      // 编码器VAD事件给出的语音状态
+    u8 onset;
+    u16 hang;
+    u16 hang_frames;
+};
+
+void rec_vad_init(int sample_rate);
+void rec_vad_enable(u8 en);
+u8 rec_vad_enabled(void);
+int rec_vad_process(const s16 *pcm, int samples);
+void rec_vad_set_ext(u8 speech);
+u8 rec_vad_is_speech(void);
+
+#endif
+
+#endif
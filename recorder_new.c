@@ -24,6 +24,15 @@
 #include "asm/gpio.h"
 #include "jl_math/kiss_fft.h"  // 或其他FFT库
 #include "howling.h"
+#include "rec_container.h"
+#include "rec_rollover.h"
+#include "rec_catalog.h"
+#include "rec_preroll.h"
+#include "rec_vad.h"
+#include "rec_arena.h"
+#include "rec_adpcm.h"
+#include "limiter.h"
+#include "pcm_convert.h"
 #include "app_music.h"
 #include "action.h"
 
@@ -47,8 +56,32 @@
 #define MAX_VOLUME_VALUE	100
 #define INIT_VOLUME_VALUE   20
 
+#define HYBRID_TICK_MS          20      // 模拟直通啸叫控制周期
+#define HYBRID_DUCK_STEP        8       // 每个周期检测到啸叫压低的模拟增益
+#define HYBRID_DUCK_MAX         40      // 最多压低的模拟增益
+#define HYBRID_HOLD_MS          1000    // 啸叫消失多久后开始恢复
+#define HYBRID_RELEASE_MS       100     // 每恢复1级增益的间隔
+
+#define RECORDER_VOICE_SAMPLERATE   16000
+#define RECORDER_MUSIC_SAMPLERATE   48000
+
+//监听通路时延档位：帧越短、缓冲越小，往返时延越低，按帧调度的开销越大
+struct monitor_profile {
+    const char *name;
+    u8 frame_ms;        // 编码器每帧时长；inplace档位也是采集中断的帧长
+    u8 enc_frames;      // 编码器底层缓冲帧数，至少3帧
+    u16 dec_buf_len;    // 解码器输出缓冲字节数，0:两帧
+    u16 cbuf_ms;        // 编解码之间的缓冲上限，写不进去就清空
+    u8 inplace;         // 采集中断按frame_ms出数，每帧就地做啸叫抑制；0时按8K字节一块
+};
+
+static const struct monitor_profile monitor_profiles[] = {
+    { "normal", 20, 3, 4 * 1024, 500, 0 },
+    { "low",    5,  3, 0,        15,  1 },
+    { "ultra",  2,  3, 0,        6,   1 },
+};
+
 
-extern void analyze_spectrum(const s16 *samples, int num_samples);
 extern float feedback_cancellation(s16 sample);
 extern void init_adaptive_params();
 extern int adapt_filter();
@@ -100,18 +133,22 @@ static const u16 sample_rate_table[] = {
 
 
 #ifdef CONFIG_SPECTRUM_FFT_EFFECT_ENABLE
+//频谱显示直接读啸叫检测那边的频谱快照，不再单独做FFT
 static void recorder_spectrum_fft_show(void *p)
 {
-    if (__this->work_buf) {
-        short *db_data = getSpectrumValue(__this->work_buf);
-        int num = getSpectrumNum(__this->work_buf);
-        if (db_data && num > 0) {
-            for (int i = 0; i < num; i++) {
-                //输出db_num个 db值
-                printf("db_data db[%d] %d\n", i, db_data[i]);
-            }
-        }
+    static struct spectrum_snapshot snap;
+    static u32 last_seq;
+    char line[SPECTRUM_BANDS * 5 + 1];
+    int pos = 0;
+
+    if (spectrum_snapshot_read(&snap) || snap.seq == last_seq) {
+        return;
     }
+    last_seq = snap.seq;
+    for (int i = 0; i < SPECTRUM_BANDS; i++) {
+        pos += snprintf(line + pos, sizeof(line) - pos, "%4d", snap.band_db[i]);
+    }
+    log_info("spectrum db: %s", line);
 }
 #endif
 #if 0
@@ -120,6 +157,50 @@ void adapt_filter_task_init(void)
     task_create(adapt_filter, 0, "adapt_filter_task");
 }
 #endif
+static const struct monitor_profile *mon_profile = &monitor_profiles[0];
+static u8 mon_channel;
+static u32 mon_cache_len;       //cache_buf实际大小，档位缓冲不能超过它
+static u8 dev_monitor_on;       //采集设备通路在跑，啸叫抑制在它的中断里做
+static int dev_sample_rate = CONFIG_AUDIO_RECORDER_SAMPLERATE;     //ADC/DAC直通设备的采样率，进模式时和录音采样率对齐
+static u8 rec_mode_ready;       //进模式时已初始化，录音键不再重新初始化
+
+#ifdef LIMITER_ENABLE
+//DAC前最后一级，防止大音量削顶失真回灌到麦克风被当成宽带啸叫
+static struct limiter mon_limiter;
+#endif
+
+#ifdef FEEDBACK_SUPPRESSION_ENABLE
+//采集中断里逐帧处理的耗时统计，证明低时延档位每帧都能在帧时长内处理完
+static struct {
+    u32 frames;
+    u32 max_us;         // 最坏单帧耗时
+    u32 budget_us;      // 帧时长
+    u32 over;           // 耗时超过帧时长一半的帧数
+} mon_cpu;
+
+static void recorder_monitor_cpu_report(void)
+{
+    if (!mon_cpu.frames || !mon_cpu.budget_us) {
+        return;
+    }
+    log_info("monitor %s: %d frames, worst %d us / %d us (%d%%), %d over half\n",
+             mon_profile->name, mon_cpu.frames, mon_cpu.max_us, mon_cpu.budget_us,
+             mon_cpu.max_us * 100 / mon_cpu.budget_us, mon_cpu.over);
+}
+
+static void recorder_monitor_cpu_add(u32 t, int samples, int sample_rate)
+{
+    mon_cpu.budget_us = (u64)samples * 1000000 / sample_rate;
+    mon_cpu.frames++;
+    if (t > mon_cpu.max_us) {
+        mon_cpu.max_us = t;
+    }
+    if (t * 2 > mon_cpu.budget_us) {
+        mon_cpu.over++;
+    }
+}
+#endif
+
 //编码器输出PCM数据
 static int recorder_vfs_fwrite(void *file, void *data, u32 len)
 {
@@ -134,51 +215,6 @@ static int recorder_vfs_fwrite(void *file, void *data, u32 len)
     os_sem_post(&__this->r_sem);
 
 
-#if FEEDBACK_SUPPRESSION_ENABLE_1
-    if(__this->feedback_suppress_en){
-        log_info("Processing %d bytes with feedback suppression\n", len);
-
-        s16 *pcm = (s16 *)data;
-        int samples = len / 2; // 16-bit样本
-        
-        // 自适应处理
-        __this->sample_counter += samples;
-        if(__this->sample_counter >= __this->adapt_interval) {
-            analyze_spectrum(pcm, samples);
-            adapt_filter();           
-            __this->sample_counter = 0;
-        }
-        
-        // 应用啸叫抑制
-        for(int i=0; i<samples; i++){
-            pcm[i] = (s16)feedback_cancellation(pcm[i]);
-        }
-    }
-#endif
-
-#ifdef CONFIG_SPECTRUM_FFT_EFFECT_ENABLE
-    u32 in_remain = len, tlen = 0;
-
-    while (in_remain) {
-        if (__this->offset < __this->out_buf_size) {
-            tlen = __this->out_buf_size - __this->offset;
-            if (tlen > in_remain) {
-                tlen = in_remain;
-            }
-            memcpy((u8 *)__this->out_buf + __this->offset, (u8 *)data + (len - in_remain), tlen);
-            __this->offset += tlen;
-            in_remain -= tlen;
-            if (in_remain && (__this->offset != __this->out_buf_size)) {
-                continue;
-            }
-        }
-        if (__this->offset == __this->out_buf_size) {
-            __this->offset = 0;
-            SpectrumShowRun(__this->work_buf, __this->out_buf, 512);
-        }
-    }
-#endif
-
     //此回调返回0录音就会自动停止
     return len;
 }
@@ -278,8 +314,21 @@ int recorder_file_close(void){
       union audio_req req = {0};
 
       //if (!__this->rec_fp) return 0; // 防止重复关闭
-      if (!__this->fp) return 0; // 防止重复关闭
+      if (!__this->fp && !__this->rec_ro && !__this->rec_adpcm) return 0; // 防止重复关闭
+
+
+#ifdef REC_PREROLL_ENABLE
+    //先让虚拟源返回0，编码器才能正常关闭
+    rec_preroll_stop();
+#endif
 
+#ifdef REC_ADPCM_ENABLE
+    //输入已返回0，写卡任务取完最后一块退出后回写文件头
+    if (__this->rec_adpcm) {
+        rec_adpcm_close(__this->rec_adpcm);
+        __this->rec_adpcm = NULL;
+    }
+#endif
 
     // 关闭录音专用服务器
     if (__this->enc_server_rec) {
@@ -306,6 +355,13 @@ int recorder_file_close(void){
        log_info("recorder_file_close**********write file len: %d \n", wlen);
     }
 
+#ifdef REC_ROLLOVER_ENABLE
+    if (__this->rec_ro) {
+        rec_rollover_close(__this->rec_ro);
+        __this->rec_ro = NULL;
+    }
+#endif
+    return 0;
 } 
 
 static int colse_enc(void){
@@ -329,6 +385,69 @@ static int colse_dec(void){
 }
 
 
+#ifdef FEEDBACK_SUPPRESSION_ENABLE
+//模拟直通时声音不经过软件，只能靠压低ADC模拟增益打断啸叫
+static int recorder_hybrid_apply(void)
+{
+    union audio_req req = {0};
+    int gain = __this->gain - __this->hybrid_duck;
+
+    if (gain < 0) {
+        gain = 0;
+    }
+    req.enc.cmd     = AUDIO_ENC_SET_VOLUME;
+    req.enc.volume  = gain;
+    return server_request(__this->enc_server, AUDIO_REQ_ENC, &req);
+}
+
+//检测在采集中断里做，这里按结果调增益：有啸叫快速压低，消失一段时间后慢慢恢复
+static void recorder_hybrid_tick(void *p)
+{
+    int duck = __this->hybrid_duck;
+
+    if (__this->hybrid_howl) {
+        __this->hybrid_howl = 0;
+        __this->hybrid_quiet_ms = 0;
+        duck += HYBRID_DUCK_STEP;
+        if (duck > HYBRID_DUCK_MAX) {
+            duck = HYBRID_DUCK_MAX;
+        }
+    } else if (duck) {
+        __this->hybrid_quiet_ms += HYBRID_TICK_MS;
+        if (__this->hybrid_quiet_ms >= HYBRID_HOLD_MS + HYBRID_RELEASE_MS) {
+            __this->hybrid_quiet_ms = HYBRID_HOLD_MS;
+            duck--;
+        }
+    }
+    if (duck != __this->hybrid_duck) {
+        __this->hybrid_duck = duck;
+        log_info("hybrid duck %d\n", duck);
+        recorder_hybrid_apply();
+    }
+}
+
+static void recorder_hybrid_start(void)
+{
+    if (__this->hybrid) {
+        return;
+    }
+    __this->hybrid_duck = 0;
+    __this->hybrid_quiet_ms = 0;
+    __this->hybrid_howl = 0;
+    __this->hybrid = 1;
+    __this->hybrid_timer_id = sys_timer_add(NULL, recorder_hybrid_tick, HYBRID_TICK_MS);
+}
+
+static void recorder_hybrid_stop(void)
+{
+    __this->hybrid = 0;
+    if (__this->hybrid_timer_id) {
+        sys_timer_del(__this->hybrid_timer_id);
+        __this->hybrid_timer_id = 0;
+    }
+}
+#endif
+
 int recorder_close(void)
 {
     union audio_req req = {0};
@@ -354,10 +473,15 @@ int recorder_close(void)
         server_request(__this->dec_server, AUDIO_REQ_DEC, &req);
     }
 
+#ifdef REC_ARENA_ENABLE
+    //cache_buf在会话内存池里，一次释放
+    __this->cache_buf = NULL;
+#else
     if (__this->cache_buf) {
         free(__this->cache_buf);
         __this->cache_buf = NULL;
     }
+#endif
 
     if (__this->fp) {
         int wlen;
@@ -371,19 +495,19 @@ int recorder_close(void)
 
 
 #ifdef CONFIG_SPECTRUM_FFT_EFFECT_ENABLE
-    if (__this->work_buf) {
-        free(__this->work_buf);
-        __this->work_buf = NULL;
-    }
-    if (__this->out_buf) {
-        free(__this->out_buf);
-        __this->out_buf = NULL;
-    }
     if (__this->show_timer_id) {
-        sys_timeout_del(__this->show_timer_id);
+        sys_timer_del(__this->show_timer_id);
         __this->show_timer_id = 0;
     }
 #endif  
+#ifdef FEEDBACK_SUPPRESSION_ENABLE
+    __this->analog_direct = 0;
+    recorder_hybrid_stop();
+#endif
+#ifdef REC_ARENA_ENABLE
+    rec_arena_close();
+    log_info("rec arena high water %d\n", rec_arena_high_water());
+#endif
     return 0;
 }
 
@@ -396,18 +520,29 @@ static void enc_server_event_handler(void *priv, int argc, int *argv)
         break;
     case AUDIO_SERVER_EVENT_SPEAK_START:
         log_i("speak start ! \n");
+#ifdef REC_VAD_ENABLE
+        rec_vad_set_ext(1);
+#endif
+#ifdef FEEDBACK_SUPPRESSION_ENABLE
+        feedback_gate_set_vad(1);
+#endif
         break;
     case AUDIO_SERVER_EVENT_SPEAK_STOP:
         log_i("speak stop ! \n");
+#ifdef REC_VAD_ENABLE
+        rec_vad_set_ext(0);
+#endif
+#ifdef FEEDBACK_SUPPRESSION_ENABLE
+        feedback_gate_set_vad(0);
+#endif
         break;
     default:
         break;
     }
 }
-// 录音文件名称
-static char* get_file_name(void){
+// 录音文件名称，part大于0时加_NN后缀(长录音切分的后续文件)
+static int make_file_name(char *file_name, int size, const char *ext, int part){
 
-    static char file_name[100] = {0};
     char time_str[64] = {0};   
     char month_dir[32] = {0}; //创建月目录
     char full_dir_path[100] = {0}; //创建路径
@@ -427,47 +562,55 @@ static char* get_file_name(void){
     strcat(time_str, "/\\U"); // 增加/扛保持目录结构    
     dir_len = strlen(time_str);
     //strftime(time_str + dir_len, sizeof(time_str) - dir_len, "%Y-%m-%dT%H-%M-%S.", &timeinfo);
-    strftime(time_str + dir_len, sizeof(time_str) - dir_len, "%d-%H-%M.", &timeinfo);
-    strcat(time_str, "mp3");    
+    strftime(time_str + dir_len, sizeof(time_str) - dir_len, "%d-%H-%M", &timeinfo);
+    if (part > 0) {
+        snprintf(time_str + strlen(time_str), sizeof(time_str) - strlen(time_str), "_%02d", part);
+    }
+    strcat(time_str, ".");
+    strcat(time_str, ext);
     log_info("recorder file name : %s\n", time_str);
+    if (dir_len + (strlen(time_str) - dir_len) * 2 + 2 > size) {
+        return -1;
+    }
+    memset(file_name, 0, size);
     memcpy(file_name, time_str, dir_len);
 
     for (u8 i = 0; i < strlen(time_str) - dir_len; ++i) {
         file_name[dir_len + i * 2] = time_str[dir_len + i];
     }
      //log_info("get_file_recorder file name : %s\n", file_name);
-     return file_name;
+     return 0;
 
 }
-//将MIC的数字信号采集后推到DAC播放
-//注意：如果需要播放两路MIC，DAC分别对应的是DACL和DACR，要留意芯片封装是否有DACR引脚出来，
-//      而且要使能DAC的双通道输出，DAC如果采用差分输出方式也只会听到第一路MIC的声音
-static int recorder_play_to_dac(int sample_rate, u8 channel)
+
+static char* get_file_name(const char *ext){
+
+    static char file_name[100] = {0};
+
+    make_file_name(file_name, sizeof(file_name), ext, 0);
+    return file_name;
+}
+
+#ifdef REC_ROLLOVER_ENABLE
+static int rec_part_file_name(char *buf, int size, int part)
+{
+    return make_file_name(buf, size, REC_CONTAINER_EXT, part);
+}
+#endif
+//打开监听通路的解码DAC和编码器，缓冲由调用者准备好
+static int recorder_monitor_open(int sample_rate, u8 channel)
 {
     int err;
     union audio_req req = {0};
-    //通过切换后关闭指示灯   
 
-    log_d("----------recorder_play_to_dac----------\n");
+    u32 frame_size = sample_rate * mon_profile->frame_ms / 1000 * 2 * channel;
 
-    if (channel > 2) {
-        channel = 2;
-    }
-    __this->cache_buf = malloc(sample_rate * channel); //上层缓冲buf缓冲0.5秒的数据，缓冲太大听感上会有延迟
-    if (__this->cache_buf == NULL) {
-        return -1;
-    }
-    cbuf_init(&__this->save_cbuf, __this->cache_buf, sample_rate * channel);
-
-    os_sem_create(&__this->w_sem, 0);
-    os_sem_create(&__this->r_sem, 0);
-
-    __this->run_flag = 1;
+    mon_channel = channel;
 
     /****************打开解码DAC器*******************/
     req.dec.cmd             = AUDIO_DEC_OPEN;
     req.dec.volume          = __this->volume;
-    req.dec.output_buf_len  = 4 * 1024;
+    req.dec.output_buf_len  = mon_profile->dec_buf_len ? mon_profile->dec_buf_len : frame_size * 2;
     req.dec.channel         = channel;
     req.dec.sample_rate     = sample_rate;
     req.dec.vfs_ops         = &recorder_vfs_ops;
@@ -478,33 +621,13 @@ static int recorder_play_to_dac(int sample_rate, u8 channel)
 
     err = server_request(__this->dec_server, AUDIO_REQ_DEC, &req);
     if (err) {
-        goto __err;
+        return err;
     }
 
     req.dec.cmd = AUDIO_DEC_START;
     req.dec.attr = AUDIO_ATTR_NO_WAIT_READY;
     server_request(__this->dec_server, AUDIO_REQ_DEC, &req);
 
-#ifdef CONFIG_SPECTRUM_FFT_EFFECT_ENABLE
-    __this->work_buf = zalloc(getSpectrumShowBuf());
-    if (!__this->work_buf) {
-        goto __err1;
-    }
-    __this->offset = 0;
-    __this->out_buf_size = 512 * 2 * channel;
-    __this->out_buf = zalloc(__this->out_buf_size);
-    if (!__this->out_buf) {
-        free(__this->work_buf);
-        __this->work_buf = NULL;
-        goto __err1;
-    }
-
-    SpectrumShowInit(__this->work_buf, 0.9, 0.9,
-                     sample_rate, channel, channel > 1 ? 2 : 0, JL_FFT_BASE);
-
-    __this->show_timer_id = sys_timer_add(NULL, recorder_spectrum_fft_show, 1000);
-#endif
-
     /****************打开编码器*******************/
     memset(&req, 0, sizeof(union audio_req));
    
@@ -517,8 +640,8 @@ static int recorder_play_to_dac(int sample_rate, u8 channel)
     } else {
         req.enc.channel_bit_map = BIT(CONFIG_AUDIO_ADC_CHANNEL_L);
     }
-    req.enc.frame_size = sample_rate / 100 * 4 * channel;	//收集够多少字节PCM数据就回调一次fwrite
-    req.enc.output_buf_len = req.enc.frame_size * 3; //底层缓冲buf至少设成3倍frame_size
+    req.enc.frame_size = frame_size;	//收集够多少字节PCM数据就回调一次fwrite
+    req.enc.output_buf_len = frame_size * mon_profile->enc_frames; //底层缓冲buf至少设成3倍frame_size
     req.enc.cmd = AUDIO_ENC_OPEN;
     req.enc.channel = channel;
     req.enc.volume = __this->gain;
@@ -535,30 +658,88 @@ static int recorder_play_to_dac(int sample_rate, u8 channel)
 
     err = server_request(__this->enc_server, AUDIO_REQ_ENC, &req);
     if (err) {
-        goto __err1;
+        req.dec.cmd = AUDIO_DEC_STOP;
+        server_request(__this->dec_server, AUDIO_REQ_DEC, &req);
+        return err;
     }
 
     return 0;
+}
 
-__err1:
-    req.dec.cmd = AUDIO_DEC_STOP;
-    server_request(__this->dec_server, AUDIO_REQ_DEC, &req);
+//编解码之间的缓冲按档位取，不超过已分配的cache_buf
+static u32 recorder_monitor_cbuf_len(int sample_rate, u8 channel)
+{
+    u32 len = sample_rate / 1000 * 2 * channel * mon_profile->cbuf_ms;
+
+    return len < mon_cache_len ? len : mon_cache_len;
+}
+
+//将MIC的数字信号采集后推到DAC播放
+//注意：如果需要播放两路MIC，DAC分别对应的是DACL和DACR，要留意芯片封装是否有DACR引脚出来，
+//      而且要使能DAC的双通道输出，DAC如果采用差分输出方式也只会听到第一路MIC的声音
+static int recorder_play_to_dac(int sample_rate, u8 channel)
+{
+    //通过切换后关闭指示灯   
+
+    log_d("----------recorder_play_to_dac----------\n");
+
+    if (channel > 2) {
+        channel = 2;
+    }
+#ifdef REC_ARENA_ENABLE
+    //本次会话的缓冲一次算好，从内存池里顺序分配
+    if (rec_arena_open(rec_arena_calc_size(sample_rate, channel, REC_ARENA_F_MONITOR))) {
+        return -1;
+    }
+    __this->cache_buf = rec_arena_alloc(sample_rate * channel);
+#else
+    __this->cache_buf = malloc(sample_rate * channel); //上层缓冲buf缓冲0.5秒的数据，缓冲太大听感上会有延迟
+#endif
+    if (__this->cache_buf == NULL) {
+        return -1;
+    }
+    //按最大档位(0.5秒)分配，切换时延档位不用重新申请
+    mon_cache_len = sample_rate * channel;
+    cbuf_init(&__this->save_cbuf, __this->cache_buf, recorder_monitor_cbuf_len(sample_rate, channel));
+
+    os_sem_create(&__this->w_sem, 0);
+    os_sem_create(&__this->r_sem, 0);
+
+    __this->run_flag = 1;
+
+    if (recorder_monitor_open(sample_rate, channel)) {
+        goto __err;
+    }
+
+#ifdef CONFIG_SPECTRUM_FFT_EFFECT_ENABLE
+    //频谱由啸叫检测的共享前端算好，这里只定时取快照
+    __this->show_timer_id = sys_timer_add(NULL, recorder_spectrum_fft_show, 1000);
+#endif
+
+    return 0;
 
 __err:
+#ifdef REC_ARENA_ENABLE
+    __this->cache_buf = NULL;
+    rec_arena_close();
+#else
     if (__this->cache_buf) {
         free(__this->cache_buf);
         __this->cache_buf = NULL;
     }
+#endif
 
     __this->run_flag = 0;
 
     return -1;
 }
 
-//MIC或者LINEIN模拟直通到DAC，不需要软件参与
+//MIC或者LINEIN模拟直通到DAC，不需要软件参与；
+//开了啸叫抑制时采集通路继续跑一份数字数据只做检测，检测到啸叫压低模拟增益
 static int audio_adc_analog_direct_to_dac(int sample_rate, u8 channel)
 {
     union audio_req req = {0};
+    int err;
 
     log_info("----------audio_adc_analog_direct_to_dac----------\n");
 
@@ -579,23 +760,83 @@ static int audio_adc_analog_direct_to_dac(int sample_rate, u8 channel)
         req.enc.channel_bit_map = BIT(CONFIG_AUDIO_ADC_CHANNEL_L);
     }
 
-    return server_request(__this->enc_server, AUDIO_REQ_ENC, &req);
+    err = server_request(__this->enc_server, AUDIO_REQ_ENC, &req);
+#ifdef FEEDBACK_SUPPRESSION_ENABLE
+    if (!err) {
+        //之后打开抑制时由开关补开旁路检测
+        __this->analog_direct = 1;
+        if (__this->feedback_suppress_en) {
+            recorder_hybrid_start();
+        }
+    }
+#endif
+    return err;
 }
 
 
+#if defined(REC_ADPCM_ENABLE) && defined(REC_PREROLL_ENABLE)
+//ADPCM录音：不开编码服务器，写卡任务直接从预录缓冲取PCM
+static int recorder_to_adpcm(void)
+{
+    char path[REC_PATH_MAX];
+
+    if (!rec_preroll_ready()) {
+        log_e("adpcm rec need capture running\n");
+        return -1;
+    }
+    if (make_file_name(path, sizeof(path), REC_ADPCM_EXT, 0)) {
+        return -1;
+    }
+
+    __this->run_flag = 1;
+    __this->direct = 0;
+
+#ifdef REC_VAD_ENABLE
+    rec_vad_init(rec_preroll_sample_rate());
+#endif
+    //先开始录音，否则写卡任务第一次取数就返回0退出
+    rec_preroll_start();
+    __this->rec_adpcm = rec_adpcm_open(path, rec_preroll_sample_rate(), rec_preroll_channel(),
+                                       rec_preroll_read_input);
+    if (!__this->rec_adpcm) {
+        rec_preroll_stop();
+        return -1;
+    }
+    return 0;
+}
+#endif
+
 //录音文件到SD卡
  int recorder_to_file(int sample_rate, u8 channel, const char *format)
 {
+#if defined(REC_ADPCM_ENABLE) && defined(REC_PREROLL_ENABLE)
+    if (!strcmp(format, REC_ADPCM_FORMAT)) {
+        return recorder_to_adpcm();
+    }
+#endif
     
-    __this->enc_server_rec = server_open("audio_server", "enc");
-    server_register_event_handler_to_task(__this->enc_server_rec, NULL, enc_server_event_handler, "app_core");
+    //录音服务器第一次录音时打开，之后每次录音复用，停止录音只关编码不关服务器
+    if (!__this->enc_server_rec) {
+        __this->enc_server_rec = server_open("audio_server", "enc");
+        server_register_event_handler_to_task(__this->enc_server_rec, NULL, enc_server_event_handler, "app_core");
+    }
     union audio_req req = {0};
 
     __this->run_flag = 1;
     __this->direct = 0;
 
     // 获取录音文件名
-    char* file_name = get_file_name();
+#ifndef REC_ROLLOVER_ENABLE
+    char* file_name = get_file_name("mp3");
+#endif
+
+#ifdef REC_PREROLL_ENABLE
+    //采集通路已在跑时，编码器直接从预录缓冲取数，按键前的几秒也能录进去
+    if (rec_preroll_ready()) {
+        sample_rate = rec_preroll_sample_rate();
+        channel = rec_preroll_channel();
+    }
+#endif
 
     req.enc.cmd = AUDIO_ENC_OPEN;
     req.enc.channel = channel;
@@ -605,8 +846,25 @@ static int audio_adc_analog_direct_to_dac(int sample_rate, u8 channel)
     req.enc.sample_rate = sample_rate;
     req.enc.format = format;   
     req.enc.sample_source = "mic";  
+#ifdef REC_PREROLL_ENABLE
+    if (rec_preroll_ready()) {
+        req.enc.sample_source = "virtual";
+        req.enc.read_input = rec_preroll_read_input;
+        req.enc.vir_data_wait = 1;
+    }
+#endif
     req.enc.msec = 0 ;//CONFIG_AUDIO_RECORDER_DURATION;
+#ifdef REC_ROLLOVER_ENABLE
+    //预分配+分块CRC，掉电后可恢复到最后一个完整块；超过大小/时长自动切到下一个文件
+    __this->rec_ro = rec_rollover_open(rec_part_file_name, sample_rate, channel, format);
+    if (!__this->rec_ro) {
+        goto __err;
+    }
+    req.enc.vfs_ops = &rec_rollover_vfs_ops;
+    req.enc.file = (FILE *)__this->rec_ro;
+#else
     req.enc.file = __this->fp = fopen(file_name, "w+");
+#endif
 //    if (!strcmp(req.enc.format, "aac")) {
         req.enc.bitrate = 16000;  sample_rate * 4;
         req.enc.no_header = 1;
@@ -620,13 +878,31 @@ static int audio_adc_analog_direct_to_dac(int sample_rate, u8 channel)
         req.enc.channel_bit_map = BIT(CONFIG_AUDIO_ADC_CHANNEL_L);
     }
 
+#ifdef REC_PREROLL_ENABLE
+    if (rec_preroll_ready()) {
+#ifdef REC_VAD_ENABLE
+        rec_vad_init(sample_rate);
+#endif
+        rec_preroll_start();
+    }
+#endif
+
     //return server_request(__this->enc_server, AUDIO_REQ_ENC, &req);
     return server_request(__this->enc_server_rec, AUDIO_REQ_ENC, &req);
+
+#ifdef REC_ROLLOVER_ENABLE
+__err:
+    //第一个文件没打开，编码器还没起，录音服务器直接关掉
+    __this->run_flag = 0;
+    server_close(__this->enc_server_rec);
+    __this->enc_server_rec = NULL;
+    return -1;
+#endif
 }
 static int rec_to_file (void)
 {
     union audio_req req = {0};
-    char* file_name = get_file_name();
+    char* file_name = get_file_name("mp3");
 
     req.enc.format = "mp3";   
     req.enc.sample_source = "mic";
@@ -673,6 +949,12 @@ static int recorder_enc_gain_change(int step)
 
     log_info("set_enc_gain: %d\n", gain);
 
+#ifdef FEEDBACK_SUPPRESSION_ENABLE
+    if (__this->hybrid) {
+        //模拟直通时保留当前的压低量
+        return recorder_hybrid_apply();
+    }
+#endif
     req.enc.cmd     = AUDIO_ENC_SET_VOLUME;
     req.enc.volume  = gain;
     return server_request(__this->enc_server, AUDIO_REQ_ENC, &req);
@@ -713,6 +995,21 @@ static int recorder_dec_volume_change(int step)
     return server_request(__this->dec_server, AUDIO_REQ_DEC, &req);
 }
 
+#ifdef REC_CONTAINER_ENABLE
+//只在进模式和插卡时调用，录音键路径上不扫目录；录音结束时由容器关闭直接追加索引
+static int recorder_storage_scan(void *priv)
+{
+    //上次录音没有正常关闭(掉电)，截断到最后一个完整块；正在录的文件也在标记里，录音中不恢复
+    if (!__this->rec_ro) {
+        rec_container_recover_pending();
+    }
+#ifdef REC_CATALOG_ENABLE
+    rec_catalog_rebuild(priv);
+#endif
+    return 0;
+}
+#endif
+
 /* 初始化录音模块*/
 static int recorder_mode_init(void)
 {
@@ -747,7 +1044,8 @@ static int recorder_mode_init(void)
 
     __this->channel = CONFIG_AUDIO_RECORDER_CHANNEL;
     __this->gain = CONFIG_AUDIO_ADC_GAIN;
-    __this->sample_rate = CONFIG_AUDIO_RECORDER_SAMPLERATE;
+    //采样率只在dev_sample_rate一处选定，默认CONFIG，运行中由recorder_set_sample_rate改，重进模式也保留
+    __this->sample_rate = dev_sample_rate;
 
 
 
@@ -756,6 +1054,8 @@ static int recorder_mode_init(void)
     // 初始化自适应啸叫抑制参数
     __this->feedback_suppress_en = 1;
     init_adaptive_params();
+    //参数按FEEDBACK_DSP_RATE初始化，换算到设备实际采样率(需要时建好降采样)
+    feedback_suppressor_rescale(__this->sample_rate);
     //启动滤波算法
     //adapt_filter_task_init();
 #endif
@@ -763,6 +1063,12 @@ static int recorder_mode_init(void)
      __this->recorder_flag =0 ;    
      __this->direct = 1;
 
+#ifdef REC_CONTAINER_ENABLE
+    if (storage_device_ready()) {
+        recorder_storage_scan(NULL);
+    }
+#endif
+
      __this->enc_server = server_open("audio_server", "enc");
     server_register_event_handler_to_task(__this->enc_server, NULL, enc_server_event_handler, "app_core");
 
@@ -780,19 +1086,140 @@ static int recorder_mode_init(void)
     __this->dec_server = NULL;
     server_close(__this->enc_server);
     __this->enc_server = NULL;
+    if (__this->enc_server_rec) {
+        server_close(__this->enc_server_rec);
+        __this->enc_server_rec = NULL;
+    }
+    rec_mode_ready = 0;
 
 }
 
+//停掉监听通路的编解码，服务器和缓冲保留
+static void recorder_monitor_stop(void)
+{
+    union audio_req req = {0};
+
+    req.enc.cmd = AUDIO_ENC_CLOSE;
+    server_request(__this->enc_server, AUDIO_REQ_ENC, &req);
+    req.dec.cmd = AUDIO_DEC_STOP;
+    server_request(__this->dec_server, AUDIO_REQ_DEC, &req);
+}
+
+//运行中切换采样率：停编解码、清缓冲、按新采样率重开，服务器和缓冲都不重新申请，
+//啸叫抑制已锁定的频点换算到新采样率继续用
+void init_adc(u8 init_flag);
+int init_dac(u8 init_flag);
+
+int recorder_set_sample_rate(int sample_rate)
+{
+    u8 monitor = __this->run_flag && __this->cache_buf;
+    u8 channel = __this->channel > 2 ? 2 : __this->channel;
+    u32 t = timer_get_ms();
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(sample_rate_table); i++) {
+        if (sample_rate_table[i] == sample_rate) {
+            break;
+        }
+    }
+    if (i == ARRAY_SIZE(sample_rate_table)) {
+        return -1;
+    }
+    if (sample_rate == dev_sample_rate && sample_rate == __this->sample_rate) {
+        return 0;
+    }
+#ifdef REC_PREROLL_ENABLE
+    //录音文件的采样率写在文件头里，录音中不能切换
+    if (rec_preroll_is_recording()) {
+        log_w("recording, sample rate not changed\n");
+        return -1;
+    }
+#endif
+
+    if (monitor) {
+        recorder_monitor_stop();
+        //缓冲里旧采样率的数据直接丢掉
+        cbuf_clear(&__this->save_cbuf);
+    }
+
+#ifdef FEEDBACK_SUPPRESSION_ENABLE
+    feedback_suppressor_rescale(sample_rate);
+#endif
+    __this->sample_rate = sample_rate;
+    dev_sample_rate = sample_rate;
+    init_dac(2);
+    init_adc(2);
+
+    if (monitor && recorder_monitor_open(sample_rate, channel)) {
+        log_e("monitor reopen err\n");
+        return -1;
+    }
+
+    log_info("sample rate -> %d, %d ms\n", sample_rate, timer_get_ms() - t);
+
+    return 0;
+}
+
+//切换监听时延档位，监听在跑时按新档位重开编解码
+int recorder_set_latency_profile(const char *name)
+{
+    const struct monitor_profile *p = NULL;
+    u8 monitor = __this->run_flag && __this->cache_buf;
+    u8 channel = __this->channel > 2 ? 2 : __this->channel;
+
+    for (int i = 0; i < ARRAY_SIZE(monitor_profiles); i++) {
+        if (!strcmp(monitor_profiles[i].name, name)) {
+            p = &monitor_profiles[i];
+            break;
+        }
+    }
+    if (!p) {
+        return -1;
+    }
+    if (p == mon_profile) {
+        return 0;
+    }
+
+    if (monitor) {
+        recorder_monitor_stop();
+    }
+    mon_profile = p;
+    //采集中断和DAC的帧长跟着档位走
+    if (dev_monitor_on) {
+        init_dac(2);
+        init_adc(2);
+    }
+    if (monitor) {
+        cbuf_init(&__this->save_cbuf, __this->cache_buf, recorder_monitor_cbuf_len(__this->sample_rate, channel));
+        if (recorder_monitor_open(__this->sample_rate, channel)) {
+            log_e("monitor reopen err\n");
+            return -1;
+        }
+    }
+    log_info("latency profile -> %s, frame %d ms\n", p->name, p->frame_ms);
+
+    return 0;
+}
+
 static void feedback_suppress_en(void){
      // 切换啸叫抑制开关            
     #ifdef FEEDBACK_SUPPRESSION_ENABLE
         __this->feedback_suppress_en = !__this->feedback_suppress_en; 
         if(__this->feedback_suppress_en){
             //rec_en();
-
+            if (__this->analog_direct) {
+                //模拟直通中打开抑制，旁路检测跟着开
+                recorder_hybrid_start();
+            }
         }else{
 
             //rec_en_close();
+            if (__this->hybrid) {
+                //关掉抑制时模拟增益恢复到用户设置
+                recorder_hybrid_stop();
+                __this->hybrid_duck = 0;
+                recorder_hybrid_apply();
+            }
         }       
  
     #endif
@@ -806,8 +1233,9 @@ void recorder_mode(u8 key)
       if(key){
             if (storage_device_ready()) {
             log_info("\n >>>>>>>>>>>>>>>>>%s %d\n",__func__,__LINE__);             
-            recorder_to_file(__this->sample_rate, __this->channel, CONFIG_AUDIO_RECORDER_SAVE_FORMAT);
+            //模式和采集通路在进模式时已打开，预录环一直在跑，这里只补开被关掉的设备
             open_recorder();            
+            recorder_to_file(__this->sample_rate, __this->channel, CONFIG_AUDIO_RECORDER_SAVE_FORMAT);
 
             }
         }else{
@@ -848,8 +1276,16 @@ static int recorder_key_click(struct key_event *key)
         recorder_dec_volume_change(VOLUME_STEP);
         break;
     case KEY_UP:        
+#ifdef REC_VAD_ENABLE
+        //切换VAD分段录音，下次开始录音生效
+        rec_vad_enable(!rec_vad_enabled());
+        log_info("vad_rec: %d\n", rec_vad_enabled());
+#endif
         break;
     case KEY_DOWN:       
+        //语音16K和音乐48K两档切换
+        recorder_set_sample_rate(__this->sample_rate == RECORDER_MUSIC_SAMPLERATE ?
+                                 RECORDER_VOICE_SAMPLERATE : RECORDER_MUSIC_SAMPLERATE);
         break;
     case KEY_MODE:
         // 应用层函数
@@ -886,6 +1322,15 @@ static int recorder_key_long(struct key_event *key)
         recorder_enc_gain_change(GAIN_STEP);
         break;
 #endif
+    case KEY_DOWN:
+        //监听时延档位轮换
+        for (int i = 0; i < ARRAY_SIZE(monitor_profiles); i++) {
+            if (&monitor_profiles[i] == mon_profile) {
+                recorder_set_latency_profile(monitor_profiles[(i + 1) % ARRAY_SIZE(monitor_profiles)].name);
+                break;
+            }
+        }
+        break;
     case KEY_MODE:
 	    feedback_suppress_en();
         break;
@@ -915,6 +1360,13 @@ int battery_per;
 static int main_dev_event_handler(struct sys_event *sys_eve)
 {
    struct device_event *device_eve = (struct device_event *)sys_eve->payload;
+
+#ifdef REC_CONTAINER_ENABLE
+   //插卡后恢复卡里掉电的录音，再把新增的录音补进索引，只扫描最近的月份目录
+   if (sys_eve->from == DEVICE_EVENT_FROM_SD && device_eve->event == DEVICE_EVENT_IN) {
+        wait_completion(sdcard_storage_device_ready, recorder_storage_scan, (void *)CONFIG_ROOT_PATH, NULL);
+   }
+#endif
    
    if (sys_eve->from == DEVICE_EVENT_FROM_POWER){
 
@@ -1011,7 +1463,7 @@ static int recorder_state_machine(struct application *app, enum app_state state,
 
         //         break;
         //  }
-         recorder_mode_init();
+         open_recorder();
         break;
     case APP_STA_PAUSE:
         break;
@@ -1046,8 +1498,151 @@ static int offset;
 cbuffer_t save_cbuf;
 static u8 cache_buf[16 * 1024];
 s16 buf[POINT_ADC / 2] sec(.sram);
+//监听通路中间结果，采集入口转成浮点，DAC出口转回16位，中间各级不限幅
+static float mon_work[POINT_ADC / 2] sec(.sram);
+
+//采集缓冲是4路麦交错的(mic0 mic1 mic2 mic3 ...)，录音和监听都只用mic1这一路
+#define MON_ADC_CHANNELS    4
+#define MON_ADC_PICK        1
+static s16 mon_in[POINT_ADC / 2] sec(.sram);
+
+//采集中断到DAC中断之间的有界队列：按样本的环形缓冲，DAC中断按自己的长度取，
+//不够补零不重放旧数据；积压超过两帧采集(DAC一次取得更多时为一次取数加一帧)就丢掉最旧的，直通时延不会越攒越大
+#define MON_DAC_FIFO        (POINT_ADC / 2 * 2)
+#define MON_DAC_STAMPS      8
+static s16 mon_dac_fifo[MON_DAC_FIFO] sec(.sram);
+static volatile u32 mon_dac_wr;     //写入的样本总数，只由采集中断改
+static volatile u32 mon_dac_rd;     //取走的样本总数，只由DAC中断改
+static u32 mon_dac_frame;           //一帧采集的样本数
+//每帧采集的起始位置和进中断的时间，DAC取到这个位置时算出采集中断到DAC中断的时延
+static struct {
+    u32 pos;
+    u32 usec;
+} mon_dac_stamp[MON_DAC_STAMPS];
+static volatile u32 mon_dac_stamp_wr;
+static u32 mon_dac_stamp_rd;
+static struct {
+    u32 frames;
+    u32 sum_us;
+    u32 max_us;
+    u32 short_reads;    // DAC要的比队列里有的多，补了零
+    u32 dropped;        // 积压超限丢掉的样本数
+    u32 adc_us;         // 一帧采集的时长
+    u32 dac_us;         // DAC一次取数的时长
+} mon_lat;
+
+//按采集帧长定积压上限，清空队列和统计，采集格式改变时调用
+static void mon_dac_reset(int frame_samples)
+{
+    local_irq_disable();
+    mon_dac_frame = frame_samples;
+    mon_dac_wr = 0;
+    mon_dac_rd = 0;
+    mon_dac_stamp_wr = 0;
+    mon_dac_stamp_rd = 0;
+    memset(&mon_lat, 0, sizeof(mon_lat));
+    mon_lat.adc_us = (u64)frame_samples * 1000000 / dev_sample_rate;
+    local_irq_enable();
+}
+
+//采集中断里调用，放不下的尾巴丢掉，DAC中断会先把积压削到上限
+static void mon_dac_push(const s16 *pcm, int n)
+{
+    u32 wr = mon_dac_wr;
+    u32 room = MON_DAC_FIFO - (wr - mon_dac_rd);
+
+    if (n > room) {
+        mon_lat.dropped += n - room;
+        n = room;
+    }
+    mon_dac_stamp[mon_dac_stamp_wr % MON_DAC_STAMPS].pos = wr;
+    mon_dac_stamp[mon_dac_stamp_wr % MON_DAC_STAMPS].usec = jiffies_usec();
+    mon_dac_stamp_wr++;
+    for (int i = 0; i < n; i++) {
+        mon_dac_fifo[(wr + i) % MON_DAC_FIFO] = pcm[i];
+    }
+    mon_dac_wr = wr + n;
+}
+
+//DAC中断里调用，取n个样本
+static void mon_dac_pop(s16 *pcm, int n)
+{
+    u32 rd = mon_dac_rd;
+    u32 wr = mon_dac_wr;
+    u32 now = jiffies_usec();
+    u32 limit = mon_dac_frame * 2;
+    int avail, i;
+
+    if (limit < n + mon_dac_frame) {
+        limit = n + mon_dac_frame;
+    }
+    if (limit > MON_DAC_FIFO) {
+        limit = MON_DAC_FIFO;
+    }
+    if (wr - rd > limit) {
+        mon_lat.dropped += wr - rd - limit;
+        rd = wr - limit;
+    }
+    avail = wr - rd;
+    if (avail && avail < n) {
+        mon_lat.short_reads++;
+    }
+    for (i = 0; i < n && i < avail; i++) {
+        pcm[i] = mon_dac_fifo[(rd + i) % MON_DAC_FIFO];
+    }
+    memset(pcm + i, 0, (n - i) * 2);
+
+    //这次取到的帧起点，按进采集中断的时间算时延；被丢掉的帧只跳过不计，来不及看的旧记录已被覆盖
+    if (mon_dac_stamp_wr - mon_dac_stamp_rd > MON_DAC_STAMPS) {
+        mon_dac_stamp_rd = mon_dac_stamp_wr - MON_DAC_STAMPS;
+    }
+    while (mon_dac_stamp_rd != mon_dac_stamp_wr &&
+           (s32)(mon_dac_stamp[mon_dac_stamp_rd % MON_DAC_STAMPS].pos - (rd + i)) < 0) {
+        u32 pos = mon_dac_stamp[mon_dac_stamp_rd % MON_DAC_STAMPS].pos;
+        u32 t = now - mon_dac_stamp[mon_dac_stamp_rd % MON_DAC_STAMPS].usec;
+        mon_dac_stamp_rd++;
+        if ((s32)(pos - rd) < 0) {
+            continue;
+        }
+        mon_lat.frames++;
+        mon_lat.sum_us += t;
+        if (t > mon_lat.max_us) {
+            mon_lat.max_us = t;
+        }
+    }
+    mon_lat.dac_us = (u64)n * 1000000 / dev_sample_rate;
+    mon_dac_rd = rd + i;
+}
+
+//麦克风到喇叭的时延：中断之间实测的排队时延，加上采集攒一帧和DAC放完一次取数的时长
+static void recorder_monitor_latency_report(void)
+{
+    if (!mon_lat.frames) {
+        return;
+    }
+    log_info("monitor %s: adc->dac avg %d us max %d us, round trip avg %d us max %d us, short %d dropped %d\n",
+             mon_profile->name, mon_lat.sum_us / mon_lat.frames, mon_lat.max_us,
+             mon_lat.sum_us / mon_lat.frames + mon_lat.adc_us + mon_lat.dac_us,
+             mon_lat.max_us + mon_lat.adc_us + mon_lat.dac_us, mon_lat.short_reads, mon_lat.dropped);
+}
+
+static int mon_pick_channel(const s16 *data, int len)
+{
+    int n = len / 2 / MON_ADC_CHANNELS;
+
+    if (n > ARRAY_SIZE(mon_in)) {
+        n = ARRAY_SIZE(mon_in);
+    }
+    for (int i = 0; i < n; i++) {
+        mon_in[i] = data[i * MON_ADC_CHANNELS + MON_ADC_PICK];
+    }
+    return n;
+}
+
 static void audio_dev_enc_irq_handler(void *priv, u8 *data, int len)
 {
+    int mon_n = mon_pick_channel((s16 *)data, len);
+
  // log_info("Processing %d audio_dev_enc_irq_handler\n", len);
 //   log_info("Feedback suppression %d\n", 
 //               __this->feedback_suppress_en );
@@ -1061,45 +1656,72 @@ static void audio_dev_enc_irq_handler(void *priv, u8 *data, int len)
 
 //    put_buf(data,64);
 
+#ifdef REC_VAD_ENABLE
+    //VAD分段录音：静音时暂停给编码器送数，语音开始时在容器里打段标记
+    if (rec_vad_enabled() && rec_preroll_is_recording()) {
+        switch (rec_vad_process(mon_in, mon_n)) {
+        case REC_VAD_EDGE_START:
+            rec_preroll_pause(0, 0);
+#ifdef REC_ROLLOVER_ENABLE
+            if (__this->rec_ro) {
+                rec_rollover_mark_segment(__this->rec_ro);
+            }
+#endif
+            break;
+        case REC_VAD_EDGE_STOP:
+            rec_preroll_pause(1, REC_VAD_ONSET_KEEP_MS);
+            break;
+        }
+    }
+#endif
+
+#ifdef REC_PREROLL_ENABLE
+    //预录环按单声道打开，只写拆出来的那一路
+    rec_preroll_write(mon_in, mon_n * 2);
+#endif
+
 #ifdef FEEDBACK_SUPPRESSION_ENABLE
+    //静音时跳过频谱分析，陷波器进入旁路
+    u8 gate_on = feedback_gate_update(mon_in, mon_n);
+    if (__this->hybrid) {
+        //模拟直通：只检测不处理，降采样后每帧频谱判一次，DAC数字输出保持静音
+        if (gate_on && feedback_analyze(mon_in, mon_n) && adapt_filter() > 0) {
+            __this->hybrid_howl = 1;
+        }
+        return;
+    }
+#ifdef CONFIG_SPECTRUM_FFT_EFFECT_ENABLE
+    //不做啸叫抑制时频谱显示也要用到共享频谱
+    if (!__this->feedback_suppress_en && gate_on) {
+        feedback_analyze(mon_in, mon_n);
+    }
+#endif
     if(__this->feedback_suppress_en){
-        int n = 0;
         //log_info("feedback_suppress_en_Processing %d bytes with feedback suppression\n", len);
-        s16 *pcm = (s16 *)data;
-        int samples = len / 2; // 16-bit样本
-        //int samples = sizeof(buf) / 2; // 16-bit样本
-        
-        // 自适应处理
-        __this->sample_counter += samples;
-        if(__this->sample_counter >= __this->adapt_interval) {
-            analyze_spectrum(pcm, samples);
-             n = adapt_filter();           
-            __this->sample_counter = 0;
-            
+        u32 t = jiffies_usec();
+        //检测和陷波用同一路mic1
+        // 自适应处理：共享频谱前端每出一帧新频谱调整一次
+        if (gate_on && feedback_analyze(mon_in, mon_n)) {
+             adapt_filter();           
         }
         
-        // 应用啸叫抑制
-        if( n > 0){
-            //log_info(">>>>>>>>>>>nnnnnnnnnnnnnnn: %d\n", n);
-            log_info(">>>>>>>>>>>start feedback_cancellation");   
-            for(int i=0; i<sizeof(buf); i++){
-                //float processed = feedback_cancellation(pcm[i*4+1]);
-                // buf[i] = (s16)processed;  // 确保数据被写回
-                buf[i] = feedback_cancellation(pcm[i*4+1]);                      
-            
-            }
-        }else{
-            for(int i = 0; i < sizeof(buf); i++){
-                buf[i] = pcm[i*4+1];
-            }
-        }
+        // 应用啸叫抑制：检测到啸叫后持续生效，没有啸叫或静音时直通
+        pcm_s16_to_float(mon_in, 1, mon_work, mon_n);
+        feedback_process_block(mon_work, mon_work, mon_n);
+#ifdef LIMITER_ENABLE
+        limiter_process(&mon_limiter, mon_work, mon_work, mon_n);
+#endif
+        pcm_float_to_s16(mon_work, buf, mon_n);
+        recorder_monitor_cpu_add(jiffies_usec() - t, mon_n, dev_sample_rate);
+        mon_dac_push(buf, mon_n);
     }
 #else
-    s16 *__data = (s16 *)data;
-
-    for(int i = 0;i < sizeof(buf);i++){
-        buf[i] = __data[i*4 + 1];//mic 0 mic1 mic2 mic3 0 1 2 3 4 5 6
-    }
+    pcm_s16_to_float(mon_in, 1, mon_work, mon_n);
+#ifdef LIMITER_ENABLE
+    limiter_process(&mon_limiter, mon_work, mon_work, mon_n);
+#endif
+    pcm_float_to_s16(mon_work, buf, mon_n);
+    mon_dac_push(buf, mon_n);
 //    cbuf_write(&save_cbuf,buf,320);
 #endif // 0
 
@@ -1122,6 +1744,48 @@ static void audio_dev_enc_irq_handler(void *priv, u8 *data, int len)
 }
 
 
+static int adc_set_format(void *dev)
+{
+    int err;
+    struct audio_format f = {0};;
+
+    f.format        = "pcm";
+    f.channel       = 1;
+    f.sample_rate   = dev_sample_rate;
+    f.volume        = 100;   
+    f.sample_source = "mic";
+    f.frame_len     = 8192;
+    f.channel_bit_map  = BIT(CONFIG_AUDIO_ADC_CHANNEL_L);
+    if (mon_profile->inplace) {
+        //低时延档位：中断按档位帧长出数，4路交错，一帧不超过拆路缓冲
+        f.frame_len = dev_sample_rate * mon_profile->frame_ms / 1000 * 2 * MON_ADC_CHANNELS;
+        if (f.frame_len > sizeof(mon_in) * MON_ADC_CHANNELS) {
+            f.frame_len = sizeof(mon_in) * MON_ADC_CHANNELS;
+        }
+    }
+
+    err = dev_ioctl(dev, AUDIOC_SET_FMT, (unsigned int)&f);
+    if (err) {
+        printf("audio_set_fmt: err");
+    }
+    //换帧长或采样率前把上一段的时延报出来，队列按新帧长定上限
+    recorder_monitor_latency_report();
+    mon_dac_reset(f.frame_len / 2 / MON_ADC_CHANNELS);
+#ifdef REC_PREROLL_ENABLE
+    rec_preroll_open(f.sample_rate, f.channel);
+#endif
+#ifdef LIMITER_ENABLE
+    limiter_init(&mon_limiter, f.sample_rate);
+#endif
+#ifdef FEEDBACK_SUPPRESSION_ENABLE
+    //换帧长或采样率前把上一段的统计报出来
+    recorder_monitor_cpu_report();
+    memset(&mon_cpu, 0, sizeof(mon_cpu));
+#endif
+    return err;
+}
+
+//init_flag: 0打开 1关闭 2按dev_sample_rate和时延档位重新设置格式
 void init_adc(u8 init_flag)
 {
      int err;
@@ -1129,6 +1793,9 @@ void init_adc(u8 init_flag)
      static int bindex ;
      static u32 parm[2];
     if(init_flag == 0){
+        if (dev) {
+            return;
+        }
         void *arg = (void *)AUDIO_TYPE_ENC_MIC; 
         dev = dev_open("audio", arg);  
         if(!dev){
@@ -1136,9 +1803,11 @@ void init_adc(u8 init_flag)
         }
         printf("\n >>>>>>>>>>>>>>>>>>%s %d\n",__func__,__LINE__);
 
+        //采集通路跟随设备，不属于录音会话，用静态缓冲避免每次打开都泄漏
+        static u8 adc_reqbuf[4096];
         struct video_reqbufs breq = {0};
-        breq.buf  = malloc(4096);
-        breq.size = 4096;
+        breq.buf  = adc_reqbuf;
+        breq.size = sizeof(adc_reqbuf);
         breq.dev.fd = NULL;
         err = dev_ioctl(dev, AUDIOC_REQBUFS, (unsigned int)&breq);
         if (err) {
@@ -1147,23 +1816,8 @@ void init_adc(u8 init_flag)
         printf("\n >>>>>>>>>>>>>>>>>>%s %d\n",__func__,__LINE__);
 
 
-        struct audio_format f = {0};;
-
-        f.format        = "pcm";
-        f.channel       = 1;
-        f.sample_rate   = 16000;
-        f.volume        = 100;   
-        f.sample_source = "mic";
-        f.frame_len     = 8192;
-
-
-            f.channel_bit_map  = BIT(CONFIG_AUDIO_ADC_CHANNEL_L);
-            printf("\n >>>>>>>>>>>>>>>>>>%s %d\n",__func__,__LINE__);
-            err = dev_ioctl(dev, AUDIOC_SET_FMT, (unsigned int)&f);
-            if (err) {
-                printf("audio_set_fmt: err");
-
-            }
+        printf("\n >>>>>>>>>>>>>>>>>>%s %d\n",__func__,__LINE__);
+        adc_set_format(dev);
         printf("\n >>>>>>>>>>>>>>>>>>%s %d\n",__func__,__LINE__);
         
         
@@ -1175,7 +1829,15 @@ void init_adc(u8 init_flag)
         printf("\n >>>>>>>>>>>>>>>>>>%s %d\n",__func__,__LINE__);
         
         err = dev_ioctl(dev, AUDIOC_STREAM_ON, (u32)&bindex);
+        dev_monitor_on = 1;
         printf("\n >>>>>>>>>>>>>>>>>>%s %d\n",__func__,__LINE__);
+     }else if(init_flag == 2){
+        //只改采样率和帧长，设备和中断回调保持不变
+        if(dev){
+            dev_ioctl(dev, AUDIOC_STREAM_OFF, (u32)&bindex);
+            adc_set_format(dev);
+            dev_ioctl(dev, AUDIOC_STREAM_ON, (u32)&bindex);
+        }
      }else{
         if(dev){
         err = dev_ioctl(dev, AUDIOC_STREAM_OFF, (u32)&bindex);
@@ -1185,6 +1847,14 @@ void init_adc(u8 init_flag)
         printf("\n >>>>>>>>>>>>>>>>>>%s %d\n",__func__,__LINE__);
         dev_close(dev);
         dev = NULL;
+        dev_monitor_on = 0;
+        recorder_monitor_latency_report();
+#ifdef FEEDBACK_SUPPRESSION_ENABLE
+        recorder_monitor_cpu_report();
+#endif
+#ifdef REC_PREROLL_ENABLE
+        rec_preroll_close();
+#endif
         log_info(">>>>>>>>>>>>>>>dac_complete close");
         }
         log_info(">>>>>>>>>>>>>>>dac_complete");
@@ -1201,8 +1871,23 @@ static void rt_talk_dac_irq_handler(void *priv, void *data, int len)
 //    memset(data,0,len);
 //   int ret =  cbuf_read(&save_cbuf,(u8 *)data,len);
 //   printf("\n ret = %d\n",cbuf_get_data_size(&save_cbuf));
-    memcpy(data,buf,len);
+    //DAC单声道，按它自己要的长度从队列里取，不够补零
+    mon_dac_pop((s16 *)data, len / 2);
+}
+//DAC单声道；低时延档位按档位帧长取数，和采集中断同一节拍，队列里只积压一帧
+static void dac_set_format_param(struct audio_format *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->volume = -1;
+    f->channel = 1;
+    f->sample_rate = dev_sample_rate;
+    f->priority = 9;
+    if (mon_profile->inplace) {
+        f->frame_len = dev_sample_rate * mon_profile->frame_ms / 1000 * 2;
+    }
 }
+
+//init_flag: 0打开 1关闭 2按dev_sample_rate和时延档位重新设置格式
 int init_dac(u8 init_flag)
 {
     int err;
@@ -1211,15 +1896,15 @@ int init_dac(u8 init_flag)
     struct audio_format f;
     static void *dev = NULL;
     if(init_flag == 0){
+        if (dev) {
+            return 0;
+        }
         dev =  dev_open("audio", (void *)AUDIO_TYPE_DEC);
         if (!dev) {
             return 0;
         }
 
-        f.volume = -1;
-        f.channel = 1;
-        f.sample_rate = 16000;
-        f.priority = 9;
+        dac_set_format_param(&f);
 
         err = dev_ioctl(dev, AUDIOC_SET_FMT, (u32)&f);
         if (err) {
@@ -1231,11 +1916,19 @@ int init_dac(u8 init_flag)
     
     dev_ioctl(dev, IOCTL_REGISTER_IRQ_HANDLER, (u32)arg);    
     dev_ioctl(dev, AUDIOC_STREAM_ON, (u32)&bindex);
+    }else if(init_flag == 2){
+        if(dev){
+            dac_set_format_param(&f);
+            dev_ioctl(dev, AUDIOC_STREAM_OFF, (u32)&bindex);
+            dev_ioctl(dev, AUDIOC_SET_FMT, (u32)&f);
+            dev_ioctl(dev, AUDIOC_STREAM_ON, (u32)&bindex);
+        }
     }else{
         if(dev){
         dev_ioctl(dev,AUDIOC_STREAM_OFF, (u32)&bindex);
         dev_ioctl(dev, IOCTL_UNREGISTER_IRQ_HANDLER, (u32)arg);
         dev_close(dev);
+        dev = NULL;
         log_info(">>>>>>>>>>>>>>>dac_complete close");
         }
         log_info(">>>>>>>>>>>>>>>dac_complete....");
@@ -1252,11 +1945,15 @@ void close_adc_dac (void)
     init_adc(1);
 }
 
+//进模式时调用一次完成初始化；之后再调用只补开已关闭的设备，不清__this也不等待
 void open_recorder(void)
 { 
-    recorder_mode_init();
-    log_info(">>>>>>>>>>>>>>>open_recorder...."); 
-    msleep(5 * 100);
+    if (!rec_mode_ready) {
+        recorder_mode_init();
+        rec_mode_ready = 1;
+        log_info(">>>>>>>>>>>>>>>open_recorder...."); 
+        msleep(5 * 100);
+    }
     init_dac(0);
     init_adc(0);
     
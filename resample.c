@@ -0,0 +1,163 @@
+/*
+@file: resample.c
+@brief: 整数倍多相FIR抽取/插值
+        抽取器每收满factor个输入才算一次完整卷积，插值器每个输入按相输出factor个样本，
+        两者都只算实际需要的输出，运算量是直接滤波的1/factor；
+        滤波器为Blackman窗sinc，截止在低采样率奈奎斯特频率的90%
+@date: 2026/10/19
+*/
+
+#include <math.h>
+#include <string.h>
+#include "app_config.h"
+#include "resample.h"
+
+#ifdef RESAMPLE_ENABLE
+
+#ifdef RESAMPLE_FIXED_POINT
+#define COEF_FROM_FLOAT(x)  ((s16)CLAMP_S16((x) * 32768.0f + ((x) >= 0 ? 0.5f : -0.5f)))
+#define DATA_FROM_FLOAT(x)  ((s16)CLAMP_S16((x) + ((x) >= 0 ? 0.5f : -0.5f)))
+#else
+#define COEF_FROM_FLOAT(x)  (x)
+#define DATA_FROM_FLOAT(x)  (x)
+#endif
+
+#define CLAMP_S16(x)        ((x) < -32768 ? -32768 : ((x) > 32767 ? 32767 : (x)))
+
+//设计低通原型，gain为通带增益
+static int resample_design(float *h, int factor, float gain)
+{
+    int taps = factor * RESAMPLE_TAPS_PER_PHASE;
+    float fc = 0.45f / factor;      // 归一化截止频率(相对高采样率)
+    float mid = (taps - 1) * 0.5f;
+    float sum = 0;
+
+    for (int i = 0; i < taps; i++) {
+        float t = i - mid;
+        float sinc = t == 0 ? 2 * fc : sinf(2 * M_PI * fc * t) / (M_PI * t);
+        float w = 0.42f - 0.5f * cosf(2 * M_PI * i / (taps - 1)) + 0.08f * cosf(4 * M_PI * i / (taps - 1));
+        h[i] = sinc * w;
+        sum += h[i];
+    }
+    for (int i = 0; i < taps; i++) {
+        h[i] *= gain / sum;
+    }
+    return taps;
+}
+
+void resample_reset(struct resample *rs)
+{
+    rs->phase = 0;
+    rs->pos = 0;
+    memset(rs->hist, 0, sizeof(rs->hist));
+}
+
+int resample_init_decimator(struct resample *rs, int factor)
+{
+    float h[RESAMPLE_MAX_TAPS];
+
+    if (factor < 1 || factor > RESAMPLE_MAX_FACTOR) {
+        return -1;
+    }
+    rs->factor = factor;
+    rs->taps = resample_design(h, factor, 1.0f);
+    //倒序存放，和延迟线按时间正序直接点乘
+    for (int i = 0; i < rs->taps; i++) {
+        rs->coef[i] = COEF_FROM_FLOAT(h[rs->taps - 1 - i]);
+    }
+    resample_reset(rs);
+    return 0;
+}
+
+int resample_init_interpolator(struct resample *rs, int factor)
+{
+    float h[RESAMPLE_MAX_TAPS];
+    int n = RESAMPLE_TAPS_PER_PHASE;
+
+    if (factor < 1 || factor > RESAMPLE_MAX_FACTOR) {
+        return -1;
+    }
+    rs->factor = factor;
+    //插值补零后能量降为1/factor，通带增益乘回来
+    rs->taps = resample_design(h, factor, (float)factor);
+    //按相重排：第p相用h[p + k*factor]，k倒序和延迟线点乘
+    for (int p = 0; p < factor; p++) {
+        for (int k = 0; k < n; k++) {
+            rs->coef[p * n + k] = COEF_FROM_FLOAT(h[p + (n - 1 - k) * factor]);
+        }
+    }
+    resample_reset(rs);
+    return 0;
+}
+
+//同倍数的抽取+插值一共延迟的高采样率样本数：两级线性相位各(taps-1)/2，
+//抽取器在每组最后一个输入时出样，再提前factor-1个
+int resample_delay(const struct resample *rs)
+{
+    return rs->taps - rs->factor;
+}
+
+//输出不限幅，保留滤波器过冲
+static inline float resample_dot(const resample_coef_t *c, const resample_data_t *x, int n)
+{
+#ifdef RESAMPLE_FIXED_POINT
+    s32 acc = 0;
+    for (int i = 0; i < n; i += 4) {
+        acc += (s32)c[i] * x[i];
+        acc += (s32)c[i + 1] * x[i + 1];
+        acc += (s32)c[i + 2] * x[i + 2];
+        acc += (s32)c[i + 3] * x[i + 3];
+    }
+    return acc * (1.0f / 32768);
+#else
+    float acc = 0;
+    for (int i = 0; i < n; i += 4) {
+        acc += c[i] * x[i] + c[i + 1] * x[i + 1] + c[i + 2] * x[i + 2] + c[i + 3] * x[i + 3];
+    }
+    return acc;
+#endif
+}
+
+//抽取：输入n个样本，返回输出样本数
+int resample_decimate(struct resample *rs, const float *in, int n, float *out)
+{
+    int taps = rs->taps;
+    int m = 0;
+
+    for (int i = 0; i < n; i++) {
+        resample_data_t x = DATA_FROM_FLOAT(in[i]);
+        rs->hist[rs->pos] = x;
+        rs->hist[rs->pos + taps] = x;
+        if (++rs->pos == taps) {
+            rs->pos = 0;
+        }
+        if (++rs->phase == rs->factor) {
+            rs->phase = 0;
+            //hist[pos..pos+taps-1]是最近taps个样本，最旧的在前
+            out[m++] = resample_dot(rs->coef, &rs->hist[rs->pos], taps);
+        }
+    }
+    return m;
+}
+
+//插值：输入n个低采样率样本，输出n*factor个
+int resample_interpolate(struct resample *rs, const float *in, int n, float *out)
+{
+    int len = RESAMPLE_TAPS_PER_PHASE;
+    int m = 0;
+
+    for (int i = 0; i < n; i++) {
+        resample_data_t x = DATA_FROM_FLOAT(in[i]);
+        rs->hist[rs->pos] = x;
+        rs->hist[rs->pos + len] = x;
+        if (++rs->pos == len) {
+            rs->pos = 0;
+        }
+        for (int p = 0; p < rs->factor; p++) {
+            out[m++] = resample_dot(&rs->coef[p * len], &rs->hist[rs->pos], len);
+        }
+    }
+    return m;
+}
+
+#endif
@@ -0,0 +1,47 @@
+/*
+@file: resample.h
+@brief: 整数倍多相FIR抽取/插值
+@date: 2026/10/19
+*/
+#ifndef _RESAMPLE_H_
+#define _RESAMPLE_H_
+
+#include "app_config.h"
+
+#define RESAMPLE_ENABLE         // 啸叫抑制降采样处理开关
+
+#ifdef RESAMPLE_ENABLE
+
+//#define RESAMPLE_FIXED_POINT  // 定点Q15实现，没有FPU的平台打开，延迟线按16位存储，超出满量程会饱和
+
+#define RESAMPLE_MAX_FACTOR     6       // 最大抽取/插值倍数(48K->8K)
+#define RESAMPLE_TAPS_PER_PHASE 12      // 每相抽头数，总抽头数=倍数*每相抽头数
+#define RESAMPLE_MAX_TAPS       (RESAMPLE_MAX_FACTOR * RESAMPLE_TAPS_PER_PHASE)
+
+#ifdef RESAMPLE_FIXED_POINT
+typedef s16 resample_coef_t;
+typedef s16 resample_data_t;
+#else
+typedef float resample_coef_t;
+typedef float resample_data_t;
+#endif
+
+struct resample {
+    int factor;
+    int taps;                                   // 总抽头数
+    int phase;                                  // 抽取器：已收进的输入样本数
+    int pos;                                    // 延迟线写位置
+    resample_coef_t coef[RESAMPLE_MAX_TAPS];    // 插值器按相重排，抽取器按时间倒序
+    resample_data_t hist[RESAMPLE_MAX_TAPS * 2];// 双份延迟线，卷积时不用取模
+};
+
+int resample_init_decimator(struct resample *rs, int factor);
+int resample_init_interpolator(struct resample *rs, int factor);
+void resample_reset(struct resample *rs);
+int resample_decimate(struct resample *rs, const float *in, int n, float *out);
+int resample_interpolate(struct resample *rs, const float *in, int n, float *out);
+int resample_delay(const struct resample *rs);
+
+#endif
+
+#endif